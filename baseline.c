@@ -0,0 +1,239 @@
+/*
+ * baseline.c - baselines and significance tests for the regression
+ *     gate (see baseline.h)
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "baseline.h"
+
+#define MAXLINE    1024  /* max string size */
+#define MAXFIELDS   128  /* max fields in a CSV row */
+
+static char msg[MAXLINE]; /* for whenever we need to compose an error message */
+
+static void unix_error(char *msg);
+static void app_error(char *msg);
+
+/*
+ * split_csv - split a CSV row in place into at most MAXFIELDS fields,
+ *     removing the quotes; returns the number of fields
+ */
+static int split_csv(char *line, char **fields)
+{
+    char *p = line, *q;
+    int n = 0;
+
+    line[strcspn(line, "\r\n")] = '\0';
+    while (n < MAXFIELDS) {
+	fields[n++] = q = p;
+	if (*p == '"') {
+	    for (p++; *p; p++) {
+		if (*p == '"' && *++p != '"')
+		    break;    /* the closing quote */
+		*q++ = *p;
+	    }
+	} else {
+	    while (*p && *p != ',')
+		*q++ = *p++;
+	}
+	if (*p != ',') {
+	    *q = '\0';
+	    break;
+	}
+	*q = '\0';
+	p++;
+    }
+    return n;
+}
+
+/*
+ * column - the index of the named column in the header, or -1
+ */
+static int column(char **header, int n, char *name)
+{
+    int i;
+
+    for (i = 0; i < n; i++)
+	if (!strcmp(header[i], name))
+	    return i;
+    return -1;
+}
+
+/*
+ * parse_samples - parse a field of space-separated numbers
+ */
+static int parse_samples(char *s, double *x)
+{
+    char *end;
+    int n = 0;
+
+    while (n < BASE_MAX_SAMPLES) {
+	x[n] = strtod(s, &end);
+	if (end == s)
+	    break;
+	n++;
+	s = end;
+    }
+    return n;
+}
+
+/*
+ * read_baseline - read the mm traces of a CSV report
+ */
+base_trace_t *read_baseline(char *path, int *n)
+{
+    FILE *fp;
+    char *line = NULL, *hdr = NULL, *header[MAXFIELDS], *f[MAXFIELDS];
+    size_t len = 0;
+    int nh, nf, cap = 16;
+    int c_alloc, c_trace, c_file, c_valid, c_ops, c_util, c_secs, c_p99;
+    base_trace_t *base, *b;
+
+    if ((fp = fopen(path, "r")) == NULL) {
+	sprintf(msg, "Could not open baseline %s", path);
+	unix_error(msg);
+    }
+    if (getline(&hdr, &len, fp) < 0) {
+	sprintf(msg, "Baseline %s is empty", path);
+	app_error(msg);
+    }
+    nh = split_csv(hdr, header);
+    c_alloc = column(header, nh, "allocator");
+    c_trace = column(header, nh, "trace");
+    c_file = column(header, nh, "file");
+    c_valid = column(header, nh, "valid");
+    c_ops = column(header, nh, "ops");
+    c_util = column(header, nh, "util");
+    c_secs = column(header, nh, "secs_samples");
+    c_p99 = column(header, nh, "p99_samples");
+    if (c_alloc < 0 || c_trace < 0 || c_file < 0 || c_valid < 0 ||
+	c_ops < 0 || c_util < 0 || c_secs < 0 || c_p99 < 0) {
+	sprintf(msg, "Baseline %s is not a CSV report of mdriver", path);
+	app_error(msg);
+    }
+
+    if ((base = (base_trace_t *)malloc(cap * sizeof(base_trace_t))) == NULL)
+	unix_error("malloc failed in read_baseline");
+    *n = 0;
+    len = 0;
+    while (getline(&line, &len, fp) >= 0) {
+	nf = split_csv(line, f);
+	if (nf != nh) {
+	    sprintf(msg, "Baseline %s has a row of %d fields, not %d", path, nf, nh);
+	    app_error(msg);
+	}
+	if (strcmp(f[c_alloc], "mm") || !strcmp(f[c_trace], "total"))
+	    continue;
+	if (*n == cap) {
+	    cap *= 2;
+	    if ((base = (base_trace_t *)realloc(base, cap * sizeof(base_trace_t))) == NULL)
+		unix_error("realloc failed in read_baseline");
+	}
+	b = &base[(*n)++];
+	if ((b->file = strdup(f[c_file])) == NULL)
+	    unix_error("strdup failed in read_baseline");
+	b->valid = atoi(f[c_valid]);
+	b->ops = atof(f[c_ops]);
+	b->util = atof(f[c_util]);
+	b->num_secs = parse_samples(f[c_secs], b->secs);
+	b->num_p99 = parse_samples(f[c_p99], b->p99);
+    }
+    free(line);
+    free(hdr);
+    fclose(fp);
+    return base;
+}
+
+/*
+ * find_baseline - the baseline of a trace file, or NULL
+ */
+base_trace_t *find_baseline(base_trace_t *base, int n, char *file)
+{
+    int i;
+
+    for (i = 0; i < n; i++)
+	if (!strcmp(base[i].file, file))
+	    return &base[i];
+    return NULL;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(double *)a, y = *(double *)b;
+    return (x > y) - (x < y);
+}
+
+/*
+ * median - the median of x[0..n-1] (which is left sorted)
+ */
+static double median(double *x, int n)
+{
+    qsort(x, n, sizeof(double), cmp_double);
+    return (n % 2) ? x[n / 2] : (x[n / 2 - 1] + x[n / 2]) / 2;
+}
+
+/*
+ * compare_samples - relative change of the median, the relative range
+ *     of the a samples, and the two-sided p-value of the Mann-Whitney U
+ *     test (normal approximation, with the tie and continuity
+ *     corrections). One slow sample moves neither the median nor the
+ *     test, unlike the mean.
+ */
+void compare_samples(double *a, int na, double *b, int nb,
+		     double *est, double *spread, double *p)
+{
+    double sa[BASE_MAX_SAMPLES], sb[BASE_MAX_SAMPLES], all[2 * BASE_MAX_SAMPLES];
+    double u = 0, mu, var, ties = 0, z;
+    int i, j, t, n = na + nb;
+
+    memcpy(sa, a, na * sizeof(double));
+    memcpy(sb, b, nb * sizeof(double));
+    *est = median(sb, nb) / median(sa, na) - 1;
+    *spread = (sa[na - 1] - sa[0]) / median(sa, na);
+
+    /* U counts the pairs where b wins, ties counting one half */
+    for (i = 0; i < na; i++)
+	for (j = 0; j < nb; j++)
+	    u += (sb[j] > sa[i]) + 0.5 * (sb[j] == sa[i]);
+
+    memcpy(all, sa, na * sizeof(double));
+    memcpy(all + na, sb, nb * sizeof(double));
+    qsort(all, n, sizeof(double), cmp_double);
+    for (i = 0; i < n; i += t) {
+	for (t = 1; i + t < n && all[i + t] == all[i]; t++)
+	    ;
+	ties += (double)t * t * t - t;
+    }
+
+    mu = na * nb / 2.0;
+    var = na * nb / 12.0 * ((n + 1) - ties / ((double)n * (n - 1)));
+    if (var <= 0) {
+	*p = 1;
+	return;
+    }
+    z = (fabs(u - mu) - 0.5) / sqrt(var);
+    *p = (z > 0) ? erfc(z / sqrt(2)) : 1;
+}
+
+/*
+ * unix_error - Report a Unix-style error
+ */
+static void unix_error(char *msg)
+{
+    printf("%s: %s\n", msg, strerror(errno));
+    exit(1);
+}
+
+/*
+ * app_error - Report an arbitrary application error
+ */
+static void app_error(char *msg)
+{
+    printf("%s\n", msg);
+    exit(1);
+}
@@ -0,0 +1,37 @@
+#ifndef __BASELINE_H_
+#define __BASELINE_H_
+
+/*
+ * Baselines for the regression gate (mdriver -B). A baseline is a CSV
+ * report written by mdriver --format=csv; the mm rows give each trace's
+ * util and its timing (and, with -L, p99 latency) samples.
+ */
+#define BASE_MAX_SAMPLES 64  /* most samples per trace (mdriver -r) */
+
+typedef struct {
+    char *file;                       /* trace file name */
+    int valid;                        /* was the trace valid? */
+    double ops;                       /* requests in the trace */
+    double util;                      /* space utilization */
+    int num_secs;                     /* timing samples ... */
+    double secs[BASE_MAX_SAMPLES];    /* ... in secs */
+    int num_p99;                      /* p99 latency samples ... */
+    double p99[BASE_MAX_SAMPLES];     /* ... in ns (none without -L) */
+} base_trace_t;
+
+/* Read the mm traces of a CSV report; returns their number in *n */
+base_trace_t *read_baseline(char *path, int *n);
+
+/* The baseline of a trace file, or NULL if it has none */
+base_trace_t *find_baseline(base_trace_t *base, int n, char *file);
+
+/*
+ * Relative change of the median from samples a[] to samples b[]
+ * (median(b)/median(a) - 1) in *est, the range of the a[] samples
+ * relative to their median in *spread, and the two-sided p-value of
+ * the Mann-Whitney U test of the two sets of samples in *p
+ */
+void compare_samples(double *a, int na, double *b, int nb,
+		     double *est, double *spread, double *p);
+
+#endif /* __BASELINE_H_ */
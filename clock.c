@@ -1,6 +1,7 @@
 /* 
- * clock.c - Routines for using the cycle counters on x86, 
- *           Alpha, and Sparc boxes.
+ * clock.c - Routines for using the cycle counters on x86, x86-64,
+ *           Alpha, and Sparc boxes, and a nanosecond counter based
+ *           on CLOCK_MONOTONIC_RAW that works everywhere.
  * 
  * Copyright (c) 2002, R. Bryant and D. O'Hallaron, All rights reserved.
  * May not be used, modified, or copied without permission.
@@ -8,7 +9,9 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <unistd.h>
+#include <time.h>
 #include <sys/times.h>
 #include "clock.h"
 
@@ -71,6 +74,48 @@ double get_counter()
 }
 /* $end x86cyclecounter */
 
+#elif defined(__x86_64__)
+/*******************************************************
+ * x86-64 versions of start_counter() and get_counter()
+ *******************************************************/
+
+/*
+ * The time stamp counter is read with lfence;rdtsc at the start, so
+ * that the instructions before it have finished, and with rdtscp;lfence
+ * at the end, so that the measured code has finished and the code after
+ * it hasn't started. On CPUs with an invariant TSC (see tsc_invariant)
+ * the counter ticks at a constant rate, whatever the core frequency.
+ */
+static uint64_t cyc_start = 0;
+
+static inline uint64_t tsc_begin(void)
+{
+    unsigned hi, lo;
+
+    asm volatile("lfence; rdtsc" : "=a" (lo), "=d" (hi) : : "memory");
+    return ((uint64_t)hi << 32) | lo;
+}
+
+static inline uint64_t tsc_end(void)
+{
+    unsigned hi, lo, aux;
+
+    asm volatile("rdtscp; lfence" : "=a" (lo), "=d" (hi), "=c" (aux) : : "memory");
+    return ((uint64_t)hi << 32) | lo;
+}
+
+/* Record the current value of the cycle counter. */
+void start_counter()
+{
+    cyc_start = tsc_begin();
+}
+
+/* Return the number of cycles since the last call to start_counter. */
+double get_counter()
+{
+    return (double)(tsc_end() - cyc_start);
+}
+
 #elif defined(__alpha)
 
 /****************************************************
@@ -163,6 +208,70 @@ double get_counter()
 
 
 
+/*
+ * has_cycle_counter - does this platform have start_counter() and
+ *     get_counter()?
+ */
+int has_cycle_counter()
+{
+#if defined(__i386__) || defined(__x86_64__) || defined(__alpha)
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+/*
+ * tsc_invariant - does the x86 time stamp counter tick at a constant
+ *     rate (CPUID leaf 0x80000007, EDX bit 8)?
+ */
+int tsc_invariant()
+{
+#if defined(__i386__) || defined(__x86_64__)
+    unsigned a, b, c, d;
+
+    asm volatile("cpuid" : "=a" (a), "=b" (b), "=c" (c), "=d" (d)
+		 : "a" (0x80000000));
+    if (a < 0x80000007)
+	return 0;
+    asm volatile("cpuid" : "=a" (a), "=b" (b), "=c" (c), "=d" (d)
+		 : "a" (0x80000007));
+    return (d >> 8) & 1;
+#else
+    return 0;
+#endif
+}
+
+
+/*************************************************************
+ * A counter of nanoseconds, with the same interface as the
+ * cycle counter. CLOCK_MONOTONIC_RAW isn't slewed by NTP, so
+ * its rate is as steady as the hardware clock behind it.
+ *************************************************************/
+
+static double raw_start = 0;
+
+static double raw_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* Record the current time */
+void start_raw_counter()
+{
+    raw_start = raw_now();
+}
+
+/* Return the number of nanoseconds since the last call to start_raw_counter */
+double get_raw_counter()
+{
+    return raw_now() - raw_start;
+}
+
+
 /*******************************
  * Machine-independent functions
  ******************************/
@@ -201,6 +310,34 @@ double mhz(int verbose)
     return mhz_full(verbose, 2);
 }
 
+/*
+ * mhz_calibrate - Estimate the clock rate by counting the cycles
+ *     against CLOCK_MONOTONIC_RAW over ms milliseconds, spinning instead
+ *     of sleeping. The median of 5 tries is returned.
+ */
+double mhz_calibrate(int verbose, int ms)
+{
+    double rate[5], ns, t;
+    int i, j;
+
+    for (i = 0; i < 5; i++) {
+	start_raw_counter();
+	start_counter();
+	while ((ns = get_raw_counter()) < ms * 1e6)
+	    ;
+	rate[i] = get_counter() / (ns / 1e3);
+	for (j = i; j > 0 && rate[j-1] > rate[j]; j--) {
+	    t = rate[j-1];
+	    rate[j-1] = rate[j];
+	    rate[j] = t;
+	}
+    }
+    if (verbose)
+	printf("Processor clock rate ~= %.1f MHz%s\n", rate[2],
+	       tsc_invariant() ? " (invariant TSC)" : "");
+    return rate[2];
+}
+
 /** Special counters that compensate for timer interrupt overhead */
 
 static double cyc_per_tick = 0.0;
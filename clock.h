@@ -15,6 +15,17 @@ double mhz(int verbose);
 /* Determine clock rate of processor, having more control over accuracy */
 double mhz_full(int verbose, int sleeptime);
 
+/* Determine clock rate of processor against CLOCK_MONOTONIC_RAW, in ms */
+double mhz_calibrate(int verbose, int ms);
+
+/* Does this platform have a cycle counter?  Is it an invariant x86 TSC? */
+int has_cycle_counter();
+int tsc_invariant();
+
+/* A nanosecond counter on CLOCK_MONOTONIC_RAW, for any platform */
+void start_raw_counter();
+double get_raw_counter();
+
 /** Special counters that compensate for timer interrupt overhead */
 
 void start_comp_counter();
@@ -5,9 +5,12 @@
  * May not be used, modified, or copied without permission.
  *
  * Uses the cycle timer routines in clock.c to estimate the
- * the time in CPU cycles for a function f.
+ * the time in CPU cycles for a function f. With set_fcyc_raw_counter,
+ * the same scheme estimates the time in nanoseconds instead, using
+ * the CLOCK_MONOTONIC_RAW counter in clock.c.
  */
 #include <stdlib.h>
+#include <math.h>
 #include <sys/times.h>
 #include <stdio.h>
 
@@ -22,6 +25,7 @@
 #define CLEAR_CACHE 0        /* Clear cache before running test function */
 #define CACHE_BYTES (1<<19)  /* Max cache size in bytes */
 #define CACHE_BLOCK 32       /* Cache block size in bytes */
+#define RAW_COUNTER 0        /* Count nanoseconds instead of cycles */
 
 static int kbest = K;
 static int maxsamples = MAXSAMPLES;
@@ -30,11 +34,15 @@ static int compensate = COMPENSATE;
 static int clear_cache = CLEAR_CACHE;
 static int cache_bytes = CACHE_BYTES;
 static int cache_block = CACHE_BLOCK;
+static int raw_counter = RAW_COUNTER;
 
 static int *cache_buf = NULL;
 
 static double *values = NULL;
 static int samplecount = 0;
+static double samplesum = 0;   /* sum of all the samples ... */
+static double samplesumsq = 0; /* ... and of their squares */
+static double spread = -1;     /* relative std deviation of the last fcyc */
 
 /* for debugging only */
 #define KEEP_VALS 0
@@ -59,6 +67,8 @@ static void init_sampler()
     samples = calloc(maxsamples+kbest, sizeof(double));
 #endif
     samplecount = 0;
+    samplesum = 0;
+    samplesumsq = 0;
 }
 
 /* 
@@ -78,6 +88,8 @@ static void add_sample(double val)
     samples[samplecount] = val;
 #endif
     samplecount++;
+    samplesum += val;
+    samplesumsq += val * val;
     /* Insertion sort */
     while (pos > 0 && values[pos-1] > values[pos]) {
 	double temp = values[pos-1];
@@ -130,7 +142,17 @@ double fcyc(test_funct f, void *argp)
 {
     double result;
     init_sampler();
-    if (compensate) {
+    if (raw_counter) {
+	do {
+	    double ns;
+	    if (clear_cache)
+		clear();
+	    start_raw_counter();
+	    f(argp);
+	    ns = get_raw_counter();
+	    add_sample(ns);
+	} while (!has_converged() && samplecount < maxsamples);
+    } else if (compensate) {
 	do {
 	    double cyc;
 	    if (clear_cache)
@@ -160,6 +182,12 @@ double fcyc(test_funct f, void *argp)
     }
 #endif
     result = values[0];
+    if (samplecount > 1 && samplesum > 0) {
+	double mean = samplesum / samplecount;
+	double var = (samplesumsq - samplecount * mean * mean) / (samplecount - 1);
+	spread = (var > 0) ? sqrt(var) / mean : 0;
+    } else
+	spread = -1;
 #if !KEEP_VALS
     free(values); 
     values = NULL;
@@ -245,6 +273,27 @@ void set_fcyc_epsilon(double epsilon_arg)
     epsilon = epsilon_arg;
 }
 
+/* 
+ * set_fcyc_raw_counter - When set, will count nanoseconds on
+ *     CLOCK_MONOTONIC_RAW instead of cycles (there is no compensation
+ *     for timer interrupts then)
+ *     Default = 0
+ */
+void set_fcyc_raw_counter(int raw)
+{
+    raw_counter = raw;
+}
+
+/*
+ * fcyc_spread - Relative standard deviation (std deviation / mean) of
+ *     all the samples taken by the last call to fcyc, or -1 if it took
+ *     only one
+ */
+double fcyc_spread(void)
+{
+    return spread;
+}
+
 
 
 
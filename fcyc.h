@@ -63,6 +63,19 @@ void set_fcyc_maxsamples(int maxsamples_arg);
  */
 void set_fcyc_epsilon(double epsilon_arg);
 
+/* 
+ * set_fcyc_raw_counter - When set, will count nanoseconds on
+ *     CLOCK_MONOTONIC_RAW instead of cycles
+ *     Default = 0
+ */
+void set_fcyc_raw_counter(int raw);
+
+/*
+ * fcyc_spread - Relative standard deviation of the samples taken by
+ *     the last call to fcyc, or -1 if it took only one
+ */
+double fcyc_spread(void);
+
 
 
 
@@ -2,16 +2,68 @@
  * High-level timing wrappers
  ****************************/
 #include <stdio.h>
+#include <string.h>
+#include <math.h>
 #include "fsecs.h"
 #include "fcyc.h"
 #include "clock.h"
 #include "ftimer.h"
 #include "config.h"
 
-static double Mhz;  /* estimated CPU clock frequency */
+/* The timing methods, selected at run time with set_fsecs_timer */
+#define FSECS_TSC    0   /* cycle counter w/K-best scheme */
+#define FSECS_CLOCK  1   /* CLOCK_MONOTONIC_RAW w/K-best scheme */
+#define FSECS_ITIMER 2   /* interval timer, average of n runs */
+#define FSECS_GETTOD 3   /* gettimeofday, average of n runs */
+
+static char *timer_names[] = {"tsc", "clock", "itimer", "gettod"};
+
+#if USE_FCYC
+static int timer = FSECS_TSC;
+#elif USE_CLOCK
+static int timer = FSECS_CLOCK;
+#elif USE_ITIMER
+static int timer = FSECS_ITIMER;
+#else
+static int timer = FSECS_GETTOD;
+#endif
+
+static int kbest = 3;      /* K of the K-best scheme ... */
+static int repeat = 10;    /* ... or runs averaged by the other methods */
+static double spread = -1; /* relative std deviation of the last fsecs */
+static double Mhz;         /* estimated CPU clock frequency */
 
 extern int verbose; /* -v option in mdriver.c */
 
+/*
+ * set_fsecs_timer - select the timing method by name; returns -1 if
+ *     there is no such method on this machine. Call before init_fsecs.
+ */
+int set_fsecs_timer(char *name)
+{
+    int i;
+
+    for (i = 0; i < sizeof(timer_names) / sizeof(char *); i++) {
+	if (!strcmp(name, timer_names[i])) {
+	    if (i == FSECS_TSC && !has_cycle_counter())
+		return -1;
+	    timer = i;
+	    return 0;
+	}
+    }
+    return -1;
+}
+
+/*
+ * set_fsecs_k - set the K of the K-best scheme (tsc and clock), and the
+ *     number of runs averaged by the other methods. Call before init_fsecs.
+ */
+void set_fsecs_k(int k)
+{
+    kbest = k;
+    repeat = k;
+}
+
 /*
  * init_fsecs - initialize the timing package
  */
@@ -19,24 +71,41 @@ void init_fsecs(void)
 {
     Mhz = 0; /* keep gcc -Wall happy */
 
-#if USE_FCYC
-    if (verbose)
-	printf("Measuring performance with a cycle counter.\n");
-
-    /* set key parameters for the fcyc package */
-    set_fcyc_maxsamples(20); 
-    set_fcyc_clear_cache(1);
-    set_fcyc_compensate(1);
-    set_fcyc_epsilon(0.01);
-    set_fcyc_k(3);
-    Mhz = mhz(verbose > 0);
-#elif USE_ITIMER
-    if (verbose)
-	printf("Measuring performance with the interval timer.\n");
-#elif USE_GETTOD
-    if (verbose)
-	printf("Measuring performance with gettimeofday().\n");
-#endif
+    if (timer == FSECS_TSC || timer == FSECS_CLOCK) {
+	/* set key parameters for the fcyc package */
+	set_fcyc_maxsamples(kbest > 6 ? 3 * kbest : 20);
+	set_fcyc_clear_cache(1);
+	set_fcyc_compensate(timer == FSECS_TSC);
+	set_fcyc_raw_counter(timer == FSECS_CLOCK);
+	set_fcyc_epsilon(0.01);
+	set_fcyc_k(kbest);
+    }
+
+    switch (timer) {
+    case FSECS_TSC:
+	if (verbose)
+	    printf("Measuring performance with a cycle counter (%d-best).\n",
+		   kbest);
+	Mhz = mhz_calibrate(verbose > 0, 100);
+	if (verbose && !tsc_invariant())
+	    printf("Warning: the cycle counter may not tick at a constant rate.\n");
+	break;
+    case FSECS_CLOCK:
+	if (verbose)
+	    printf("Measuring performance with CLOCK_MONOTONIC_RAW (%d-best).\n",
+		   kbest);
+	break;
+    case FSECS_ITIMER:
+	if (verbose)
+	    printf("Measuring performance with the interval timer (%d runs).\n",
+		   repeat);
+	break;
+    case FSECS_GETTOD:
+	if (verbose)
+	    printf("Measuring performance with gettimeofday() (%d runs).\n",
+		   repeat);
+	break;
+    }
 }
 
 /*
@@ -44,14 +113,53 @@ void init_fsecs(void)
  */
 double fsecs(fsecs_test_funct f, void *argp) 
 {
-#if USE_FCYC
-    double cycles = fcyc(f, argp);
-    return cycles/(Mhz*1e6);
-#elif USE_ITIMER
-    return ftimer_itimer(f, argp, 10);
-#elif USE_GETTOD
-    return ftimer_gettod(f, argp, 10);
-#endif 
+    double secs, sum = 0, sumsq = 0, mean, var;
+    int i;
+
+    switch (timer) {
+    case FSECS_TSC:
+	secs = fcyc(f, argp) / (Mhz * 1e6);
+	spread = fcyc_spread();
+	return secs;
+    case FSECS_CLOCK:
+	secs = fcyc(f, argp) / 1e9;
+	spread = fcyc_spread();
+	return secs;
+    case FSECS_ITIMER:
+	/* Too coarse to time the runs one at a time */
+	spread = -1;
+	return ftimer_itimer(f, argp, repeat);
+    default:
+	for (i = 0; i < repeat; i++) {
+	    secs = ftimer_gettod(f, argp, 1);
+	    sum += secs;
+	    sumsq += secs * secs;
+	}
+	mean = sum / repeat;
+	if (repeat > 1 && mean > 0) {
+	    var = (sumsq - repeat * mean * mean) / (repeat - 1);
+	    spread = (var > 0) ? sqrt(var) / mean : 0;
+	} else
+	    spread = -1;
+	return mean;
+    }
 }
 
+/*
+ * fsecs_spread - Return the relative standard deviation of the runs
+ *     behind the last fsecs result, or -1 if it isn't known
+ */
+double fsecs_spread(void)
+{
+    return spread;
+}
 
+/*
+ * fsecs_timer - Return the name of the timing method, and its K (or
+ *     the number of runs it averages) in *k
+ */
+char *fsecs_timer(int *k)
+{
+    *k = (timer == FSECS_TSC || timer == FSECS_CLOCK) ? kbest : repeat;
+    return timer_names[timer];
+}
@@ -1,4 +1,15 @@
 typedef void (*fsecs_test_funct)(void *);
 
+/* Select the timing method ("tsc", "clock", "itimer" or "gettod") and
+   the K of the K-best scheme (or the runs to average); before init_fsecs */
+int set_fsecs_timer(char *name);
+void set_fsecs_k(int k);
+
 void init_fsecs(void);
 double fsecs(fsecs_test_funct f, void *argp);
+
+/* Relative std deviation of the runs behind the last fsecs, or -1 */
+double fsecs_spread(void);
+
+/* Name of the timing method, and its K (or runs averaged) */
+char *fsecs_timer(int *k);
@@ -0,0 +1,82 @@
+/*
+ * lhist.c - log-bucketed latency histograms (see lhist.h)
+ */
+#include <string.h>
+
+#include "lhist.h"
+
+#define SUB (1 << LHIST_SUB_BITS)
+
+/*
+ * bucket - the bucket of value v
+ */
+static int bucket(uint64_t v)
+{
+    int m, shift, i;
+
+    if (v < SUB)
+	return (int)v;
+    m = 63 - __builtin_clzll(v);      /* v is in [2^m, 2^(m+1)) */
+    shift = m - LHIST_SUB_BITS;
+    i = ((shift + 1) << LHIST_SUB_BITS) | (int)((v >> shift) & (SUB - 1));
+    return (i < LHIST_BUCKETS) ? i : LHIST_BUCKETS - 1;
+}
+
+/*
+ * bucket_high - the largest value in bucket i
+ */
+static uint64_t bucket_high(int i)
+{
+    int shift = (i >> LHIST_SUB_BITS) - 1;
+
+    if (shift < 0)
+	return (uint64_t)i;
+    return (((uint64_t)(SUB | (i & (SUB - 1))) + 1) << shift) - 1;
+}
+
+void lhist_reset(lhist_t *h)
+{
+    memset(h, 0, sizeof(lhist_t));
+}
+
+void lhist_record(lhist_t *h, uint64_t value)
+{
+    h->count[bucket(value)]++;
+    h->n++;
+    if (value > h->max)
+	h->max = value;
+}
+
+void lhist_merge(lhist_t *dst, lhist_t *src)
+{
+    int i;
+
+    for (i = 0; i < LHIST_BUCKETS; i++)
+	dst->count[i] += src->count[i];
+    dst->n += src->n;
+    if (src->max > dst->max)
+	dst->max = src->max;
+}
+
+/*
+ * lhist_percentile - the value at or below which p percent of the
+ *     values lie (the top of its bucket, but never above the max)
+ */
+uint64_t lhist_percentile(lhist_t *h, double p)
+{
+    uint64_t rank, seen = 0, v;
+    int i;
+
+    if (h->n == 0)
+	return 0;
+    rank = (uint64_t)(p / 100.0 * h->n + 0.5);
+    if (rank < 1)
+	rank = 1;
+    for (i = 0; i < LHIST_BUCKETS; i++) {
+	seen += h->count[i];
+	if (seen >= rank)
+	    break;
+    }
+    v = bucket_high(i < LHIST_BUCKETS ? i : LHIST_BUCKETS - 1);
+    return (v < h->max) ? v : h->max;
+}
@@ -0,0 +1,28 @@
+#ifndef __LHIST_H_
+#define __LHIST_H_
+
+#include <stdint.h>
+
+/*
+ * Log-bucketed latency histograms, in the style of HdrHistogram: the
+ * values below 2^LHIST_SUB_BITS have a bucket each, and every power
+ * of two above is split into 2^LHIST_SUB_BITS buckets, so a bucket is
+ * within 1/2^LHIST_SUB_BITS (6%) of the values in it. Values (in ns)
+ * up to 2^LHIST_MAX_BITS are kept; larger ones go in the last bucket.
+ */
+#define LHIST_SUB_BITS 4
+#define LHIST_MAX_BITS 40
+#define LHIST_BUCKETS  ((LHIST_MAX_BITS - LHIST_SUB_BITS + 1) << LHIST_SUB_BITS)
+
+typedef struct {
+    uint64_t count[LHIST_BUCKETS];
+    uint64_t n;     /* values recorded */
+    uint64_t max;   /* largest value recorded */
+} lhist_t;
+
+void lhist_reset(lhist_t *h);
+void lhist_record(lhist_t *h, uint64_t value);
+void lhist_merge(lhist_t *dst, lhist_t *src);
+uint64_t lhist_percentile(lhist_t *h, double p);
+
+#endif /* __LHIST_H_ */
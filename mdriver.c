@@ -7,6 +7,7 @@
  * Copyright (c) 2002, R. Bryant and D. O'Hallaron, All rights reserved.
  * May not be used, modified, or copied without permission.
  */
+#define _GNU_SOURCE   /* for sched_setaffinity */
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -14,12 +15,23 @@
 #include <string.h>
 #include <assert.h>
 #include <float.h>
+#include <math.h>
 #include <time.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <poll.h>
+#include <getopt.h>
+#include <sys/wait.h>
+#include <sys/utsname.h>
 
 #include "mm.h"
 #include "memlib.h"
 #include "fsecs.h"
 #include "config.h"
+#include "trace.h"
+#include "lhist.h"
+#include "baseline.h"
+#include "perfctr.h"
 
 /**********************
  * Constants and macros
@@ -30,6 +42,19 @@
 #define HDRLINES       4 /* number of header lines in a trace file */
 #define LINENUM(i) (i+5) /* cnvt trace request nums to linenums (origin 1) */
 
+/* Output formats (--format) */
+#define FORMAT_TEXT 0
+#define FORMAT_JSON 1
+#define FORMAT_CSV  2
+
+/* A timing change against the baseline (-B) counts when p is below this */
+#define SIGNIFICANCE 0.05
+
+/* The CFLAGS mdriver was built with (set by the Makefile) */
+#ifndef BUILD_CFLAGS
+#define BUILD_CFLAGS "unknown"
+#endif
+
 /* Returns true if p is ALIGNMENT-byte aligned */
 #define IS_ALIGNED(p)  ((((unsigned int)(p)) % ALIGNMENT) == 0)
 
@@ -37,31 +62,15 @@
  * The key compound data types 
  *****************************/
 
-/* Records the extent of each block's payload */
+/* Records the extent of each block's payload (a node of the range tree) */
 typedef struct range_t {
     char *lo;              /* low payload address */
     char *hi;              /* high payload address */
-    struct range_t *next;  /* next list element */
+    unsigned int prio;     /* treap priority, hashed from lo */
+    struct range_t *left;  /* ranges below lo */
+    struct range_t *right; /* ranges above hi */
 } range_t;
 
-/* Characterizes a single trace operation (allocator request) */
-typedef struct {
-    enum {ALLOC, FREE, REALLOC} type; /* type of request */
-    int index;                        /* index for free() to use later */
-    int size;                         /* byte size of alloc/realloc request */
-} traceop_t;
-
-/* Holds the information for one trace file*/
-typedef struct {
-    int sugg_heapsize;   /* suggested heap size (unused) */
-    int num_ids;         /* number of alloc/realloc ids */
-    int num_ops;         /* number of distinct requests */
-    int weight;          /* weight for this trace (unused) */
-    traceop_t *ops;      /* array of requests */
-    char **blocks;       /* array of ptrs returned by malloc/realloc... */
-    size_t *block_sizes; /* ... and a corresponding array of payload sizes */
-} trace_t;
-
 /* 
  * Holds the params to the xxx_speed functions, which are timed by fcyc. 
  * This struct is necessary because fcyc accepts only a pointer array
@@ -70,17 +79,42 @@ typedef struct {
 typedef struct {
     trace_t *trace;  
     range_t *ranges;
+    int *live;       /* ids of the live blocks, for sweeps (-W) ... */
+    int *livepos;    /* ... the position of each id in live[] ... */
+    size_t *sizes;   /* ... and their payload sizes */
 } speed_t;
 
+/* How the timing runs touch the payloads (-W) */
+typedef struct {
+    int write;       /* write each new payload */
+    int read;        /* read each payload before it is freed */
+    int sweep;       /* read all the live payloads every sweep ops, or 0 */
+    int stride;      /* bytes between the bytes touched */
+    char spec[64];   /* the -W argument */
+} touch_t;
+
 /* Summarizes the important stats for some malloc function on some trace */
 typedef struct {
     /* defined for both libc malloc and student malloc package (mm.c) */
     double ops;      /* number of ops (malloc/free/realloc) in the trace */
     int valid;       /* was the trace processed correctly by the allocator? */
     double secs;     /* number of secs needed to run the trace */
+    double spread;   /* relative std deviation of the timing runs, or -1 */
 
     /* defined only for the student malloc package */
     double util;     /* space utilization for this trace (always 0 for libc) */
+    int sbrks;       /* number of mem_sbrk calls for this trace (always 0 for libc) */
+    double tail;     /* bytes of heap above the highest payload ever returned */
+    struct mm_stats heap; /* allocator statistics after the util run */
+    lhist_t lat[3];  /* latency of each request type, in ns (-L) */
+
+    /* repeated samples for the regression gate (-r); secs is the best */
+    int num_samples;
+    double secs_samples[BASE_MAX_SAMPLES];
+    double p99_samples[BASE_MAX_SAMPLES]; /* p99 of all requests (-L) */
+
+    /* hardware events of one speed run (-P), -1 if a counter is missing */
+    double perf[PERF_COUNTERS];
 
     /* Note: secs and util are only defined if valid is true */
 } stats_t; 
@@ -90,6 +124,19 @@ typedef struct {
  *******************/
 int verbose = 0;        /* global flag for verbose output */
 static int errors = 0;  /* number of errs found when running student malloc */
+static int latency = 0; /* time every request of the mm run (-L) */
+static uint64_t lat_overhead = 0; /* ns taken by a pair of clock reads */
+static int format = FORMAT_TEXT; /* output format (--format) */
+static int samples = 0;  /* timing samples per trace (-r), 0 if not set */
+static int counters = 0; /* count hardware events of the mm run (-P) */
+
+/* The throughput the perf index is normalised against, and where it's from */
+static double ref_thruput = AVG_LIBC_THRUPUT;
+static char *ref_source = "AVG_LIBC_THRUPUT";
+static int capped = 1;   /* cap the throughput score at ref_thruput (-u) */
+
+static touch_t touch = {0, 0, 0, 64, ""}; /* payload touching (-W) */
+static int touching = 0;
 char msg[MAXLINE];      /* for whenever we need to compose an error message */
 
 /* Directory where default tracefiles are found */
@@ -105,31 +152,55 @@ static char *default_tracefiles[] = {
  * Function prototypes 
  *********************/
 
-/* these functions manipulate range lists */
+/* these functions manipulate the range tree */
 static int add_range(range_t **ranges, char *lo, int size, 
-		     int tracenum, int opnum);
+		     int tracenum, long long opnum);
 static void remove_range(range_t **ranges, char *lo);
 static void clear_ranges(range_t **ranges);
 
-/* These functions read, allocate, and free storage for traces */
-static trace_t *read_trace(char *tracedir, char *filename);
-static void free_trace(trace_t *trace);
-
 /* Routines for evaluating the correctness and speed of libc malloc */
 static int eval_libc_valid(trace_t *trace, int tracenum);
 static void eval_libc_speed(void *ptr);
+static void eval_libc_touch(void *ptr);
 
 /* Routines for evaluating correctnes, space utilization, and speed 
    of the student's malloc package in mm.c */
 static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges);
-static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges);
+static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges,
+			   stats_t *stats);
 static void eval_mm_speed(void *ptr);
+static void eval_mm_touch(void *ptr);
+static int parse_touch(char *spec);
+static int eval_mm_stream(char *tracedir, char *filename, int tracenum,
+			  range_t **ranges, stats_t *stats);
+static uint64_t clock_overhead(void);
+static double eval_mm_latency(trace_t *trace, stats_t *stats);
+
+/* Routines that evaluate a trace, in the driver or in worker processes */
+static void eval_trace(char *filename, int tracenum, int stream,
+		       stats_t *libc_stats, stats_t *mm_stats);
+static void run_workers(char **tracefiles, int n, int jobs, int serial_timing,
+			int stream, stats_t *libc_stats, stats_t *mm_stats);
 
 /* Various helper routines */
 static void printresults(int n, stats_t *stats);
+static void printlatency(int n, stats_t *stats);
+static void printperf(int n, stats_t *stats);
+static void printreport(FILE *out, char **tracefiles, int n, int jobs,
+			int stream, stats_t *libc_stats, stats_t *mm_stats,
+			double perfindex);
+static int compare_baseline(char *path, char **tracefiles, int n,
+			    stats_t *stats, double *thresholds);
+static int parse_thresholds(char *spec, double *thresholds);
+static char *calibration_key(char **tracefiles);
+static int read_calibration(char *path, char *key, double *thruput);
+static void write_calibration(char *path, char *key, double thruput);
+#ifdef MM_STATS
+static void printcounters(int n, stats_t *stats);
+#endif
 static void usage(void);
 static void unix_error(char *msg);
-static void malloc_error(int tracenum, int opnum, char *msg);
+static void malloc_error(int tracenum, long long opnum, char *msg);
 static void app_error(char *msg);
 
 /**************
@@ -141,24 +212,41 @@ int main(int argc, char **argv)
     char c;
     char **tracefiles = NULL;  /* null-terminated array of trace file names */
     int num_tracefiles = 0;    /* the number of traces in that array */
-    trace_t *trace = NULL;     /* stores a single trace file in memory */
-    range_t *ranges = NULL;    /* keeps track of block extents for one trace */
     stats_t *libc_stats = NULL;/* libc stats for each trace */
     stats_t *mm_stats = NULL;  /* mm (i.e. student) stats for each trace */
-    speed_t speed_params;      /* input parameters to the xx_speed routines */ 
 
     int team_check = 1;  /* If set, check team structure (reset by -a) */
     int run_libc = 0;    /* If set, run libc malloc (set by -l) */
     int autograder = 0;  /* If set, emit summary info for autograder (-g) */
+    int stream = 0;      /* If set, stream the traces instead (-S) */
+    int jobs = 1;        /* Number of worker processes (set by -j) */
+    int serial_timing = 0; /* If set, workers time one at a time (-s) */
 
     /* temporaries used to compute the performance index */
     double secs, ops, util, avg_mm_util, avg_mm_throughput, p1, p2, perfindex;
     int numcorrect;
+
+    FILE *report = NULL; /* where the JSON or CSV report goes (--format) */
+    char *baseline = NULL; /* CSV report to compare with (-B) */
+    double thresholds[3] = {1.0, 5.0, 10.0}; /* util, thru, p99 (-G) */
+    int regressions = 0;
+    int measure_libc = 0;    /* normalise against libc, measured now (-m) */
+    char *calibration = NULL;/* per-host file of libc throughputs (-c) */
+    char *calkey = NULL;     /* this host's and traces' key in that file */
+    static struct option longopts[] = {
+	{"format", required_argument, NULL, 'F'},
+	{"baseline", required_argument, NULL, 'B'},
+	{"samples", required_argument, NULL, 'r'},
+	{"threshold", required_argument, NULL, 'G'},
+	{"touch", required_argument, NULL, 'W'},
+	{NULL, 0, NULL, 0}
+    };
     
     /* 
      * Read and interpret the command line arguments 
      */
-    while ((c = getopt(argc, argv, "f:t:hvVgal")) != EOF) {
+    while ((c = getopt_long(argc, argv, "f:t:j:k:r:B:G:T:F:c:W:hvVgalLmPsSu",
+			    longopts, NULL)) != EOF) {
         switch (c) {
 	case 'g': /* Generate summary info for the autograder */
 	    autograder = 1;
@@ -184,6 +272,81 @@ int main(int argc, char **argv)
         case 'l': /* Run libc malloc */
             run_libc = 1;
             break;
+        case 'L': /* Time every request of the mm run */
+            latency = 1;
+            break;
+        case 'j': /* Evaluate the traces on worker processes */
+            if ((jobs = atoi(optarg)) < 1) {
+		usage();
+		exit(1);
+	    }
+            break;
+        case 'F': /* Output format */
+            if (!strcmp(optarg, "json"))
+		format = FORMAT_JSON;
+	    else if (!strcmp(optarg, "csv"))
+		format = FORMAT_CSV;
+	    else if (!strcmp(optarg, "text"))
+		format = FORMAT_TEXT;
+	    else {
+		usage();
+		exit(1);
+	    }
+            break;
+        case 'm': /* Normalise throughput against libc, measured now */
+            measure_libc = 1;
+            break;
+        case 'c': /* ... or against libc, from a calibration file */
+            calibration = optarg;
+            break;
+        case 'W': /* Touch the payloads in the timing runs */
+            if (parse_touch(optarg) < 0) {
+		usage();
+		exit(1);
+	    }
+            break;
+        case 'u': /* Don't cap the throughput score */
+            capped = 0;
+            break;
+        case 'P': /* Count hardware events */
+            counters = 1;
+            break;
+        case 'B': /* Compare with a baseline */
+            baseline = optarg;
+            break;
+        case 'r': /* Timing samples per trace */
+            samples = atoi(optarg);
+            if (samples < 1 || samples > BASE_MAX_SAMPLES) {
+		fprintf(stderr, "-r takes 1 to %d samples\n", BASE_MAX_SAMPLES);
+		exit(1);
+	    }
+            break;
+        case 'G': /* Regression thresholds */
+            if (parse_thresholds(optarg, thresholds) < 0) {
+		usage();
+		exit(1);
+	    }
+            break;
+        case 'k': /* K of the K-best scheme, or runs to average */
+            if (atoi(optarg) < 1) {
+		usage();
+		exit(1);
+	    }
+            set_fsecs_k(atoi(optarg));
+            break;
+        case 'T': /* Timing method */
+            if (set_fsecs_timer(optarg) < 0) {
+		fprintf(stderr, "Unknown or unavailable timer: %s\n", optarg);
+		usage();
+		exit(1);
+	    }
+            break;
+        case 's': /* Don't let the workers' timing runs overlap */
+            serial_timing = 1;
+            break;
+        case 'S': /* Stream the traces instead of reading them into memory */
+            stream = 1;
+            break;
         case 'v': /* Print per-trace performance breakdown */
             verbose = 1;
             break;
@@ -198,6 +361,29 @@ int main(int argc, char **argv)
             exit(1);
         }
     }
+
+    /* A baseline is compared over repeated samples of each trace */
+    if (samples == 0)
+	samples = baseline ? 10 : 1;
+    if (baseline && stream) {
+	fprintf(stderr, "-B can't be used with -S\n");
+	exit(1);
+    }
+    if ((measure_libc || calibration) && stream) {
+	fprintf(stderr, "-m and -c can't be used with -S (streamed traces don't time libc)\n");
+	exit(1);
+    }
+
+    /*
+     * A JSON or CSV report gets standard output to itself; everything
+     * else that would have been printed goes to standard error
+     */
+    if (format != FORMAT_TEXT) {
+	fflush(stdout);
+	if ((i = dup(STDOUT_FILENO)) < 0 || (report = fdopen(i, "w")) == NULL ||
+	    dup2(STDERR_FILENO, STDOUT_FILENO) < 0)
+	    unix_error("Could not set up the report in main");
+    }
 	
     /* 
      * Check and print team info 
@@ -235,51 +421,40 @@ int main(int argc, char **argv)
 	printf("Using default tracefiles in %s\n", tracedir);
     }
 
+    /*
+     * Find the reference throughput in the calibration file, or else
+     * time libc malloc on the traces to find it (and save it there)
+     */
+    if (calibration) {
+	calkey = calibration_key(tracefiles);
+	if (read_calibration(calibration, calkey, &ref_thruput))
+	    ref_source = "calibration";
+	else
+	    measure_libc = 1;
+    }
+    if (measure_libc)
+	run_libc = 1;
+
     /* Initialize the timing package */
+    if (touching && verbose)
+	printf("Touching payloads in the timing runs: %s (stride %d).\n",
+	       touch.spec, touch.stride);
     init_fsecs();
+    if (latency)
+	lat_overhead = clock_overhead();
+    if (counters && perf_open() == 0) {
+	printf("Warning: no hardware counters are available, ignoring -P.\n");
+	counters = 0;
+    }
 
-    /*
-     * Optionally run and evaluate the libc malloc package 
+    /* 
+     * Allocate the stats arrays, with one stats_t struct per tracefile
      */
     if (run_libc) {
-	if (verbose > 1)
-	    printf("\nTesting libc malloc\n");
-	
-	/* Allocate libc stats array, with one stats_t struct per tracefile */
 	libc_stats = (stats_t *)calloc(num_tracefiles, sizeof(stats_t));
 	if (libc_stats == NULL)
 	    unix_error("libc_stats calloc in main failed");
-	
-	/* Evaluate the libc malloc package using the K-best scheme */
-	for (i=0; i < num_tracefiles; i++) {
-	    trace = read_trace(tracedir, tracefiles[i]);
-	    libc_stats[i].ops = trace->num_ops;
-	    if (verbose > 1)
-		printf("Checking libc malloc for correctness, ");
-	    libc_stats[i].valid = eval_libc_valid(trace, i);
-	    if (libc_stats[i].valid) {
-		speed_params.trace = trace;
-		if (verbose > 1)
-		    printf("and performance.\n");
-		libc_stats[i].secs = fsecs(eval_libc_speed, &speed_params);
-	    }
-	    free_trace(trace);
-	}
-
-	/* Display the libc results in a compact table */
-	if (verbose) {
-	    printf("\nResults for libc malloc:\n");
-	    printresults(num_tracefiles, libc_stats);
-	}
     }
-
-    /*
-     * Always run and evaluate the student's mm package
-     */
-    if (verbose > 1)
-	printf("\nTesting mm malloc\n");
-
-    /* Allocate the mm stats array, with one stats_t struct per tracefile */
     mm_stats = (stats_t *)calloc(num_tracefiles, sizeof(stats_t));
     if (mm_stats == NULL)
 	unix_error("mm_stats calloc in main failed");
@@ -287,24 +462,42 @@ int main(int argc, char **argv)
     /* Initialize the simulated memory system in memlib.c */
     mem_init(); 
 
-    /* Evaluate student's mm malloc package using the K-best scheme */
-    for (i=0; i < num_tracefiles; i++) {
-	trace = read_trace(tracedir, tracefiles[i]);
-	mm_stats[i].ops = trace->num_ops;
-	if (verbose > 1)
-	    printf("Checking mm_malloc for correctness, ");
-	mm_stats[i].valid = eval_mm_valid(trace, i, &ranges);
-	if (mm_stats[i].valid) {
-	    if (verbose > 1)
-		printf("efficiency, ");
-	    mm_stats[i].util = eval_mm_util(trace, i, &ranges);
-	    speed_params.trace = trace;
-	    speed_params.ranges = ranges;
-	    if (verbose > 1)
-		printf("and performance.\n");
-	    mm_stats[i].secs = fsecs(eval_mm_speed, &speed_params);
-	}
-	free_trace(trace);
+    if (verbose > 1) {
+	if (stream)
+	    printf("\nStreaming mm malloc\n");
+	else
+	    printf(run_libc ? "\nTesting libc and mm malloc\n" : "\nTesting mm malloc\n");
+    }
+
+    /* Evaluate the traces one by one, or on jobs worker processes (-j) */
+    if (jobs > 1)
+	run_workers(tracefiles, num_tracefiles, jobs, serial_timing, stream,
+		    libc_stats, mm_stats);
+    else
+	for (i=0; i < num_tracefiles; i++)
+	    eval_trace(tracefiles[i], i, stream,
+		       run_libc ? &libc_stats[i] : NULL, &mm_stats[i]);
+
+    /*
+     * Streamed traces are replayed once each, checking correctness and
+     * measuring utilization and time in the same pass. The times include
+     * the checks, so they don't make a performance index.
+     */
+    if (stream) {
+	printf("\nResults for mm malloc (streamed):\n");
+	printresults(num_tracefiles, mm_stats);
+	if (errors)
+	    printf("Terminated with %d errors\n", errors);
+	if (report)
+	    printreport(report, tracefiles, num_tracefiles, jobs, stream,
+			NULL, mm_stats, -1);
+	exit(errors != 0);
+    }
+
+    /* Display the libc results in a compact table */
+    if (run_libc && verbose) {
+	printf("\nResults for libc malloc:\n");
+	printresults(num_tracefiles, libc_stats);
     }
 
     /* Display the mm results in a compact table */
@@ -314,6 +507,18 @@ int main(int argc, char **argv)
 	printf("\n");
     }
 
+    /* Display the tail latencies of the mm requests */
+    if (latency) {
+	printlatency(num_tracefiles, mm_stats);
+	printf("\n");
+    }
+
+    /* Display the hardware events of the mm requests */
+    if (counters) {
+	printperf(num_tracefiles, mm_stats);
+	printf("\n");
+    }
+
     /* 
      * Accumulate the aggregate statistics for the student's mm package 
      */
@@ -330,6 +535,34 @@ int main(int argc, char **argv)
     }
     avg_mm_util = util/num_tracefiles;
 
+    /*
+     * The reference throughput is libc's, if it was measured on this run
+     */
+    if (measure_libc) {
+	secs = ops = 0;
+	for (i=0; i < num_tracefiles; i++) {
+	    secs += libc_stats[i].secs;
+	    ops += libc_stats[i].ops;
+	    if (!libc_stats[i].valid)
+		break;
+	}
+	if (i == num_tracefiles && secs > 0) {
+	    ref_thruput = ops/secs;
+	    ref_source = "libc";
+	    if (calibration)
+		write_calibration(calibration, calkey, ref_thruput);
+	} else
+	    printf("Warning: libc malloc failed a trace, using AVG_LIBC_THRUPUT.\n");
+	secs = ops = 0;
+	for (i=0; i < num_tracefiles; i++) {
+	    secs += mm_stats[i].secs;
+	    ops += mm_stats[i].ops;
+	}
+    }
+    if (verbose || ref_thruput != AVG_LIBC_THRUPUT)
+	printf("Reference throughput = %.0f Kops (%s)%s\n", ref_thruput/1e3,
+	       ref_source, capped ? "" : ", uncapped");
+
     /* 
      * Compute and print the performance index 
      */
@@ -337,19 +570,20 @@ int main(int argc, char **argv)
 	avg_mm_throughput = ops/secs;
 
 	p1 = UTIL_WEIGHT * avg_mm_util;
-	if (avg_mm_throughput > AVG_LIBC_THRUPUT) {
+	if (capped && avg_mm_throughput > ref_thruput) {
 	    p2 = (double)(1.0 - UTIL_WEIGHT);
 	} 
 	else {
 	    p2 = ((double) (1.0 - UTIL_WEIGHT)) * 
-		(avg_mm_throughput/AVG_LIBC_THRUPUT);
+		(avg_mm_throughput/ref_thruput);
 	}
 	
 	perfindex = (p1 + p2)*100.0;
-	printf("Perf index = %.0f (util) + %.0f (thru) = %.0f/100\n",
+	printf("Perf index = %.0f (util) + %.0f (thru) = %.0f%s\n",
 	       p1*100, 
 	       p2*100, 
-	       perfindex);
+	       perfindex,
+	       capped ? "/100" : "");
 	
     }
     else { /* There were errors */
@@ -362,27 +596,508 @@ int main(int argc, char **argv)
 	printf("perfidx:%.0f\n", perfindex);
     }
 
+    /* Check for regressions against the baseline */
+    if (baseline)
+	regressions = compare_baseline(baseline, tracefiles, num_tracefiles,
+				       mm_stats, thresholds);
+
+    if (report)
+	printreport(report, tracefiles, num_tracefiles, jobs, stream,
+		    libc_stats, mm_stats, perfindex);
+
+    exit(regressions ? 2 : 0);
+}
+
+
+/*****************************************************************
+ * The following routines evaluate one trace, either in the driver
+ * itself or in a worker process. mm.c and memlib.c keep their state
+ * in globals, so traces can only be evaluated in parallel by separate
+ * processes (-j): each forked worker gets a copy-on-write copy of the
+ * simulated heap, is pinned to a core of its own, and sends its
+ * stats_t results back to the driver over a pipe. Repeated timing
+ * samples (-r) are each taken in a forked child too.
+ ****************************************************************/
+
+/* What a worker sends back for its trace */
+typedef struct {
+    int errors;      /* errors found in the trace */
+    stats_t libc;    /* libc results (if run with -l) */
+    stats_t mm;      /* mm results */
+} result_t;
+
+/* One timing sample of the mm package */
+typedef struct {
+    double secs;     /* the speed run ... */
+    double spread;   /* ... and the spread of its K runs */
+    double p99;      /* p99 latency of all requests (-L) ... */
+    lhist_t lat[3];  /* ... and the histograms it came from */
+} sample_t;
+
+static int timing_fd = -1;  /* file locked around timing runs (-s), or -1 */
+
+/*
+ * timed_fsecs - fsecs (and the spread of its runs), holding the timing
+ *     lock if the workers must take turns timing. The lock is an fcntl lock, so the kernel
+ *     releases it if a worker dies while holding it.
+ */
+static double timed_fsecs(fsecs_test_funct f, void *argp, double *spread)
+{
+    struct flock fl;
+    double secs;
+
+    memset(&fl, 0, sizeof(fl));
+    fl.l_whence = SEEK_SET;
+    if (timing_fd >= 0) {
+	fl.l_type = F_WRLCK;
+	while (fcntl(timing_fd, F_SETLKW, &fl) < 0)
+	    if (errno != EINTR)
+		unix_error("fcntl failed in timed_fsecs");
+    }
+    secs = fsecs(f, argp);
+    *spread = fsecs_spread();
+    if (timing_fd >= 0) {
+	fl.l_type = F_UNLCK;
+	fcntl(timing_fd, F_SETLK, &fl);
+    }
+    return secs;
+}
+
+/*
+ * write_all - write len bytes to fd, or exit
+ */
+static void write_all(int fd, void *buf, size_t len)
+{
+    char *p = (char *)buf;
+    ssize_t n;
+
+    while (len > 0) {
+	if ((n = write(fd, p, len)) < 0) {
+	    if (errno == EINTR)
+		continue;
+	    unix_error("write failed in write_all");
+	}
+	p += n;
+	len -= n;
+    }
+}
+
+/*
+ * read_all - read len bytes from fd; returns 0 if the writer went
+ *     away before sending all of them
+ */
+static int read_all(int fd, void *buf, size_t len)
+{
+    char *p = (char *)buf;
+    ssize_t n;
+
+    while (len > 0) {
+	if ((n = read(fd, p, len)) < 0) {
+	    if (errno == EINTR)
+		continue;
+	    unix_error("read failed in read_all");
+	}
+	if (n == 0)
+	    return 0;
+	p += n;
+	len -= n;
+    }
+    return 1;
+}
+
+/*
+ * run_sample - time the speed run of the mm package, and with -L
+ *     replay the trace for its latencies
+ */
+static void run_sample(fsecs_test_funct f, speed_t *params, sample_t *s)
+{
+    static stats_t lat_stats;
+    int t;
+
+    s->secs = timed_fsecs(f, params, &s->spread);
+    if (latency) {
+	for (t = 0; t < 3; t++)
+	    lhist_reset(&lat_stats.lat[t]);
+	s->p99 = eval_mm_latency(params->trace, &lat_stats);
+	memcpy(s->lat, lat_stats.lat, sizeof(s->lat));
+    }
+}
+
+/*
+ * take_sample - run_sample in a forked child. How fast a trace replays
+ *     depends on the process (where its pages land, for one), so the
+ *     samples of one process agree with each other much more closely
+ *     than with those of another, and comparing them with a baseline's
+ *     would find differences that aren't there. A child writes the
+ *     simulated heap's pages afresh, so its samples vary as those of
+ *     separate runs do.
+ */
+static void take_sample(fsecs_test_funct f, speed_t *params, sample_t *s)
+{
+    int pipefd[2], status, ok;
+    pid_t pid;
+
+    if (pipe(pipefd) < 0)
+	unix_error("pipe failed in take_sample");
+    fflush(stdout);  /* don't let the child inherit buffered output */
+    if ((pid = fork()) < 0)
+	unix_error("fork failed in take_sample");
+    if (pid == 0) {
+	close(pipefd[0]);
+	run_sample(f, params, s);
+	write_all(pipefd[1], s, sizeof(*s));
+	exit(0);
+    }
+    close(pipefd[1]);
+    ok = read_all(pipefd[0], s, sizeof(*s));
+    close(pipefd[0]);
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR)
+	;
+    if (!ok)
+	app_error("A timing sample's child died in take_sample");
+}
+
+/*
+ * eval_trace - evaluate libc malloc (if libc_stats isn't NULL) and the
+ *     mm malloc package on one trace file
+ */
+static void eval_trace(char *filename, int tracenum, int stream,
+		       stats_t *libc_stats, stats_t *mm_stats)
+{
+    static range_t *ranges = NULL; /* block extents, reused for each trace */
+    trace_t *trace;
+    speed_t speed_params;
+    fsecs_test_funct mm_speed = touching ? eval_mm_touch : eval_mm_speed;
+    sample_t sample;
+    int r, t;
+
+    if (stream) {
+	mm_stats->valid = eval_mm_stream(tracedir, filename, tracenum,
+					 &ranges, mm_stats);
+	mm_stats->spread = -1;
+	mm_stats->num_samples = 1;
+	mm_stats->secs_samples[0] = mm_stats->secs;
+	for (t = 0; t < PERF_COUNTERS; t++)
+	    mm_stats->perf[t] = -1;  /* streamed traces aren't counted */
+	return;
+    }
+
+    /* The trace is read once, and shared by all the phases below */
+    trace = read_trace(tracedir, filename);
+    memset(&speed_params, 0, sizeof(speed_params));
+    if (touching &&
+	((speed_params.live = (int *)malloc((trace->num_ids + 1) * sizeof(int))) == NULL ||
+	 (speed_params.livepos = (int *)malloc((trace->num_ids + 1) * sizeof(int))) == NULL ||
+	 (speed_params.sizes = (size_t *)malloc((trace->num_ids + 1) * sizeof(size_t))) == NULL))
+	unix_error("malloc failed in eval_trace");
+
+    /* Optionally evaluate the libc malloc package using the K-best scheme */
+    if (libc_stats != NULL) {
+	libc_stats->ops = trace->num_ops;
+	if (verbose > 1)
+	    printf("Checking libc malloc for correctness, ");
+	libc_stats->valid = eval_libc_valid(trace, tracenum);
+	if (libc_stats->valid) {
+	    speed_params.trace = trace;
+	    if (verbose > 1)
+		printf("and performance.\n");
+	    libc_stats->secs = timed_fsecs(touching ? eval_libc_touch : eval_libc_speed,
+					   &speed_params, &libc_stats->spread);
+	    libc_stats->num_samples = 1;
+	    libc_stats->secs_samples[0] = libc_stats->secs;
+	}
+    }
+
+    /* Always evaluate student's mm malloc package using the K-best scheme */
+    mm_stats->ops = trace->num_ops;
+    if (verbose > 1)
+	printf("Checking mm_malloc for correctness, ");
+    mm_stats->valid = eval_mm_valid(trace, tracenum, &ranges);
+    if (mm_stats->valid) {
+	if (verbose > 1)
+	    printf("efficiency, ");
+	mm_stats->util = eval_mm_util(trace, tracenum, &ranges, mm_stats);
+	speed_params.trace = trace;
+	speed_params.ranges = ranges;
+	if (verbose > 1)
+	    printf("and performance.\n");
+	if (latency && verbose > 1)
+	    printf("Timing every mm request.\n");
+
+	/* One sample is taken here, repeated samples each in a child */
+	for (t = 0; t < 3; t++)
+	    lhist_reset(&mm_stats->lat[t]);
+	for (r = 0; r < samples; r++) {
+	    if (samples > 1)
+		take_sample(mm_speed, &speed_params, &sample);
+	    else
+		run_sample(mm_speed, &speed_params, &sample);
+	    mm_stats->secs_samples[r] = sample.secs;
+	    if (r == 0 || sample.secs < mm_stats->secs) {
+		mm_stats->secs = sample.secs;
+		mm_stats->spread = sample.spread;
+	    }
+	    if (latency) {
+		mm_stats->p99_samples[r] = sample.p99;
+		for (t = 0; t < 3; t++)
+		    lhist_merge(&mm_stats->lat[t], &sample.lat[t]);
+	    }
+	}
+	mm_stats->num_samples = samples;
+	if (counters) {
+	    if (verbose > 1)
+		printf("Counting hardware events.\n");
+	    perf_count(mm_speed, &speed_params, mm_stats->perf);
+	}
+    }
+    free(speed_params.live);
+    free(speed_params.livepos);
+    free(speed_params.sizes);
+    free_trace(trace);
+}
+
+/*
+ * run_worker - the body of a worker process: evaluate trace tracenum
+ *     on cpu, and write the results to fd
+ */
+static void run_worker(char *filename, int tracenum, int stream, int run_libc,
+		       int cpu, int fd)
+{
+    result_t res;
+    cpu_set_t set;
+
+    if (cpu >= 0) {
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	sched_setaffinity(0, sizeof(set), &set);  /* best effort */
+    }
+
+    memset(&res, 0, sizeof(res));
+    errors = 0;
+    eval_trace(filename, tracenum, stream, run_libc ? &res.libc : NULL, &res.mm);
+    res.errors = errors;
+    write_all(fd, &res, sizeof(res));
     exit(0);
 }
 
+/*
+ * run_workers - evaluate the n traces on up to jobs worker processes
+ *     at a time, each pinned to a different core. A result may not fit
+ *     in a pipe, so it is read as soon as the pipe has data, before the
+ *     worker is reaped.
+ */
+static void run_workers(char **tracefiles, int n, int jobs, int serial_timing,
+			int stream, stats_t *libc_stats, stats_t *mm_stats)
+{
+    pid_t *pid;           /* worker of each trace */
+    int *fd;              /* ... the read end of its pipe */
+    int *slot;            /* ... and its slot in cpus[] */
+    int *cpus;            /* the cores we may run on */
+    int *busy;            /* is the slot of that core in use? */
+    struct pollfd *pfd;   /* the pipes of the running workers ... */
+    int *which;           /* ... and their traces */
+    int ncpus = 0, next = 0, running = 0, i, k, s, status;
+    int pipefd[2];
+    cpu_set_t set;
+    result_t res;
+    FILE *lockfile = NULL;
+
+    /* The cores the workers are pinned to, in turn */
+    if ((pid = (pid_t *)calloc(n, sizeof(pid_t))) == NULL ||
+	(fd = (int *)calloc(n, sizeof(int))) == NULL ||
+	(slot = (int *)calloc(n, sizeof(int))) == NULL ||
+	(cpus = (int *)calloc(jobs, sizeof(int))) == NULL ||
+	(busy = (int *)calloc(jobs, sizeof(int))) == NULL ||
+	(pfd = (struct pollfd *)calloc(jobs, sizeof(struct pollfd))) == NULL ||
+	(which = (int *)calloc(jobs, sizeof(int))) == NULL)
+	unix_error("calloc failed in run_workers");
+    if (sched_getaffinity(0, sizeof(set), &set) == 0)
+	for (i = 0; i < CPU_SETSIZE && ncpus < jobs; i++)
+	    if (CPU_ISSET(i, &set))
+		cpus[ncpus++] = i;
+    for (s = ncpus; s < jobs; s++)  /* more jobs than cores: don't pin */
+	cpus[s] = -1;
+
+    if (serial_timing) {
+	if ((lockfile = tmpfile()) == NULL)
+	    unix_error("tmpfile failed in run_workers");
+	timing_fd = fileno(lockfile);
+    }
+
+    while (next < n || running > 0) {
+	/* Start workers until all the slots are busy */
+	while (next < n && running < jobs) {
+	    for (s = 0; busy[s]; s++)
+		;
+	    if (pipe(pipefd) < 0)
+		unix_error("pipe failed in run_workers");
+	    fflush(stdout);  /* don't let the worker inherit buffered output */
+	    if ((pid[next] = fork()) < 0)
+		unix_error("fork failed in run_workers");
+	    if (pid[next] == 0) {
+		close(pipefd[0]);
+		run_worker(tracefiles[next], next, stream, libc_stats != NULL,
+			   cpus[s], pipefd[1]);
+	    }
+	    close(pipefd[1]);
+	    fd[next] = pipefd[0];
+	    slot[next] = s;
+	    busy[s] = 1;
+	    running++;
+	    next++;
+	}
+
+	/* Collect the results of the next worker to finish */
+	for (k = 0, i = 0; k < next; k++) {
+	    if (fd[k] >= 0) {
+		pfd[i].fd = fd[k];
+		pfd[i].events = POLLIN;
+		which[i++] = k;
+	    }
+	}
+	if (poll(pfd, i, -1) < 0) {
+	    if (errno == EINTR)
+		continue;
+	    unix_error("poll failed in run_workers");
+	}
+	for (i = 0; pfd[i].revents == 0; i++)
+	    ;
+	k = which[i];
+	if (read_all(fd[k], &res, sizeof(res))) {
+	    errors += res.errors;
+	    mm_stats[k] = res.mm;
+	    if (libc_stats != NULL)
+		libc_stats[k] = res.libc;
+	} else {
+	    errors++;
+	    printf("ERROR [trace %d]: worker %d died\n", k, (int)pid[k]);
+	    mm_stats[k].valid = 0;
+	}
+	while (waitpid(pid[k], &status, 0) < 0 && errno == EINTR)
+	    ;
+	close(fd[k]);
+	fd[k] = -1;
+	busy[slot[k]] = 0;
+	running--;
+    }
+
+    if (lockfile != NULL) {
+	fclose(lockfile);
+	timing_fd = -1;
+    }
+    free(pid);
+    free(fd);
+    free(slot);
+    free(cpus);
+    free(busy);
+    free(pfd);
+    free(which);
+}
+
 
 /*****************************************************************
- * The following routines manipulate the range list, which keeps 
+ * The following routines manipulate the range tree, which keeps 
  * track of the extent of every allocated block payload. We use the 
- * range list to detect any overlapping allocated blocks.
+ * range tree to detect any overlapping allocated blocks.
+ *
+ * The tree is a treap ordered by payload address: a binary search
+ * tree that is also a heap on a priority hashed from the address, so
+ * it stays balanced (expected O(log n) depth) whatever order the
+ * blocks arrive in. Since the payloads in the tree never overlap,
+ * a new payload can only overlap its neighbors in address order.
+ * Range records come from a pool instead of one malloc each.
  ****************************************************************/
 
+#define RANGE_CHUNK 4096  /* range records allocated at a time */
+
+static range_t *range_pool = NULL;  /* free records, linked by left */
+
+/*
+ * new_range - take a range record from the pool
+ */
+static range_t *new_range(void)
+{
+    range_t *p;
+    int i;
+
+    if (range_pool == NULL) {
+	if ((p = (range_t *)malloc(RANGE_CHUNK * sizeof(range_t))) == NULL)
+	    unix_error("malloc error in new_range");
+	for (i = 0; i < RANGE_CHUNK; i++) {
+	    p[i].left = range_pool;
+	    range_pool = &p[i];
+	}
+    }
+    p = range_pool;
+    range_pool = p->left;
+    return p;
+}
+
+/*
+ * free_range - give a range record back to the pool
+ */
+static void free_range(range_t *p)
+{
+    p->left = range_pool;
+    range_pool = p;
+}
+
+/*
+ * split_ranges - split tree t into the ranges below key (*l) and
+ *     the ranges at or above key (*r)
+ */
+static void split_ranges(range_t *t, char *key, range_t **l, range_t **r)
+{
+    while (t != NULL) {
+	if (t->lo < key) {
+	    *l = t;
+	    l = &t->right;
+	    t = t->right;
+	} else {
+	    *r = t;
+	    r = &t->left;
+	    t = t->left;
+	}
+    }
+    *l = *r = NULL;
+}
+
+/*
+ * merge_ranges - join trees a and b, where every range in a lies
+ *     below every range in b
+ */
+static range_t *merge_ranges(range_t *a, range_t *b)
+{
+    range_t *t;
+    range_t **tp = &t;
+
+    while (a != NULL && b != NULL) {
+	if (a->prio > b->prio) {
+	    *tp = a;
+	    tp = &a->right;
+	    a = a->right;
+	} else {
+	    *tp = b;
+	    tp = &b->left;
+	    b = b->left;
+	}
+    }
+    *tp = (a != NULL) ? a : b;
+    return t;
+}
+
 /*
  * add_range - As directed by request opnum in trace tracenum,
  *     we've just called the student's mm_malloc to allocate a block of 
  *     size bytes at addr lo. After checking the block for correctness,
- *     we create a range struct for this block and add it to the range list. 
+ *     we create a range struct for this block and add it to the range tree. 
  */
 static int add_range(range_t **ranges, char *lo, int size, 
-		     int tracenum, int opnum)
+		     int tracenum, long long opnum)
 {
     char *hi = lo + size - 1;
-    range_t *p;
+    range_t *p, *below = NULL, *above = NULL;
+    range_t **tp;
     char msg[MAXLINE];
 
     assert(size > 0);
@@ -404,27 +1119,45 @@ static int add_range(range_t **ranges, char *lo, int size,
         return 0;
     }
 
-    /* The payload must not overlap any other payloads */
-    for (p = *ranges;  p != NULL;  p = p->next) {
-        if ((lo >= p->lo && lo <= p-> hi) ||
-            (hi >= p->lo && hi <= p->hi)) {
-	    sprintf(msg, "Payload (%p:%p) overlaps another payload (%p:%p)\n",
-		    lo, hi, p->lo, p->hi);
-	    malloc_error(tracenum, opnum, msg);
-	    return 0;
-        }
+    /* 
+     * The payload must not overlap any other payloads. Only the
+     * nearest payloads below and above lo can overlap it.
+     */
+    for (p = *ranges; p != NULL; ) {
+	if (p->lo <= lo) {
+	    below = p;
+	    p = p->right;
+	} else {
+	    above = p;
+	    p = p->left;
+	}
+    }
+    p = NULL;
+    if (below != NULL && below->hi >= lo)
+	p = below;
+    else if (above != NULL && above->lo <= hi)
+	p = above;
+    if (p != NULL) {
+	sprintf(msg, "Payload (%p:%p) overlaps another payload (%p:%p)\n",
+		lo, hi, p->lo, p->hi);
+	malloc_error(tracenum, opnum, msg);
+	return 0;
     }
 
     /* 
      * Everything looks OK, so remember the extent of this block 
-     * by creating a range struct and adding it the range list.
+     * by creating a range struct and adding it the range tree: walk
+     * down to where its priority belongs, and split the subtree
+     * there around it.
      */
-    if ((p = (range_t *)malloc(sizeof(range_t))) == NULL)
-	unix_error("malloc error in add_range");
-    p->next = *ranges;
+    p = new_range();
     p->lo = lo;
     p->hi = hi;
-    *ranges = p;
+    p->prio = (unsigned int)((((unsigned long)lo) * 2654435761UL) >> 7);
+    for (tp = ranges; *tp != NULL && (*tp)->prio >= p->prio; )
+	tp = (lo < (*tp)->lo) ? &(*tp)->left : &(*tp)->right;
+    split_ranges(*tp, lo, &p->left, &p->right);
+    *tp = p;
     return 1;
 }
 
@@ -433,18 +1166,14 @@ static int add_range(range_t **ranges, char *lo, int size,
  */
 static void remove_range(range_t **ranges, char *lo)
 {
+    range_t **tp = ranges;
     range_t *p;
-    range_t **prevpp = ranges;
-    int size;
 
-    for (p = *ranges;  p != NULL; p = p->next) {
-        if (p->lo == lo) {
-	    *prevpp = p->next;
-            size = p->hi - p->lo + 1;
-            free(p);
-            break;
-        }
-        prevpp = &(p->next);
+    while ((p = *tp) != NULL && p->lo != lo)
+	tp = (lo < p->lo) ? &p->left : &p->right;
+    if (p != NULL) {
+	*tp = merge_ranges(p->left, p->right);
+	free_range(p);
     }
 }
 
@@ -453,140 +1182,46 @@ static void remove_range(range_t **ranges, char *lo)
  */
 static void clear_ranges(range_t **ranges)
 {
-    range_t *p;
+    range_t *p = *ranges;
     range_t *pnext;
 
-    for (p = *ranges;  p != NULL;  p = pnext) {
-        pnext = p->next;
-        free(p);
+    /* rotate left children up until the root has none, then free it */
+    while (p != NULL) {
+	if (p->left != NULL) {
+	    pnext = p->left;
+	    p->left = pnext->right;
+	    pnext->right = p;
+	} else {
+	    pnext = p->right;
+	    free_range(p);
+	}
+	p = pnext;
     }
     *ranges = NULL;
 }
 
 
-/**********************************************
- * The following routines manipulate tracefiles
- *********************************************/
+/**********************************************************************
+ * The following functions evaluate the correctness, space utilization,
+ * and throughput of the libc and mm malloc packages.
+ **********************************************************************/
 
 /*
- * read_trace - read a trace file and store it in memory
+ * eval_mm_valid - Check the mm malloc package for correctness
  */
-static trace_t *read_trace(char *tracedir, char *filename)
+static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges) 
 {
-    FILE *tracefile;
-    trace_t *trace;
-    char type[MAXLINE];
-    char path[MAXLINE];
-    unsigned index, size;
-    unsigned max_index = 0;
-    unsigned op_index;
-
-    if (verbose > 1)
-	printf("Reading tracefile: %s\n", filename);
-
-    /* Allocate the trace record */
-    if ((trace = (trace_t *) malloc(sizeof(trace_t))) == NULL)
-	unix_error("malloc 1 failed in read_trance");
-	
-    /* Read the trace file header */
-    strcpy(path, tracedir);
-    strcat(path, filename);
-    if ((tracefile = fopen(path, "r")) == NULL) {
-	sprintf(msg, "Could not open %s in read_trace", path);
-	unix_error(msg);
-    }
-    fscanf(tracefile, "%d", &(trace->sugg_heapsize)); /* not used */
-    fscanf(tracefile, "%d", &(trace->num_ids));     
-    fscanf(tracefile, "%d", &(trace->num_ops));     
-    fscanf(tracefile, "%d", &(trace->weight));        /* not used */
-    
-    /* We'll store each request line in the trace in this array */
-    if ((trace->ops = 
-	 (traceop_t *)malloc(trace->num_ops * sizeof(traceop_t))) == NULL)
-	unix_error("malloc 2 failed in read_trace");
-
-    /* We'll keep an array of pointers to the allocated blocks here... */
-    if ((trace->blocks = 
-	 (char **)malloc(trace->num_ids * sizeof(char *))) == NULL)
-	unix_error("malloc 3 failed in read_trace");
-
-    /* ... along with the corresponding byte sizes of each block */
-    if ((trace->block_sizes = 
-	 (size_t *)malloc(trace->num_ids * sizeof(size_t))) == NULL)
-	unix_error("malloc 4 failed in read_trace");
-    
-    /* read every request line in the trace file */
-    index = 0;
-    op_index = 0;
-    while (fscanf(tracefile, "%s", type) != EOF) {
-	switch(type[0]) {
-	case 'a':
-	    fscanf(tracefile, "%u %u", &index, &size);
-	    trace->ops[op_index].type = ALLOC;
-	    trace->ops[op_index].index = index;
-	    trace->ops[op_index].size = size;
-	    max_index = (index > max_index) ? index : max_index;
-	    break;
-	case 'r':
-	    fscanf(tracefile, "%u %u", &index, &size);
-	    trace->ops[op_index].type = REALLOC;
-	    trace->ops[op_index].index = index;
-	    trace->ops[op_index].size = size;
-	    max_index = (index > max_index) ? index : max_index;
-	    break;
-	case 'f':
-	    fscanf(tracefile, "%ud", &index);
-	    trace->ops[op_index].type = FREE;
-	    trace->ops[op_index].index = index;
-	    break;
-	default:
-	    printf("Bogus type character (%c) in tracefile %s\n", 
-		   type[0], path);
-	    exit(1);
-	}
-	op_index++;
-	
-    }
-    fclose(tracefile);
-    assert(max_index == trace->num_ids - 1);
-    assert(trace->num_ops == op_index);
-    
-    return trace;
-}
-
-/*
- * free_trace - Free the trace record and the three arrays it points
- *              to, all of which were allocated in read_trace().
- */
-void free_trace(trace_t *trace)
-{
-    free(trace->ops);         /* free the three arrays... */
-    free(trace->blocks);      
-    free(trace->block_sizes);
-    free(trace);              /* and the trace record itself... */
-}
-
-/**********************************************************************
- * The following functions evaluate the correctness, space utilization,
- * and throughput of the libc and mm malloc packages.
- **********************************************************************/
-
-/*
- * eval_mm_valid - Check the mm malloc package for correctness
- */
-static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges) 
-{
-    int i, j;
-    int index;
-    int size;
-    int oldsize;
-    char *newp;
-    char *oldp;
-    char *p;
-    
-    /* Reset the heap and free any records in the range list */
-    mem_reset_brk();
-    clear_ranges(ranges);
+    int i, j;
+    int index;
+    int size;
+    int oldsize;
+    char *newp;
+    char *oldp;
+    char *p;
+    
+    /* Reset the heap and free any records in the range tree */
+    mem_reset_brk();
+    clear_ranges(ranges);
 
     /* Call the mm package's init function */
     if (mm_init() < 0) {
@@ -611,7 +1246,7 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 	    
 	    /* 
 	     * Test the range of the new block for correctness and add it 
-	     * to the range list if OK. The block must be  be aligned properly,
+	     * to the range tree if OK. The block must be  be aligned properly,
 	     * and must not overlap any currently allocated block. 
 	     */ 
 	    if (add_range(ranges, p, size, tracenum, i) == 0)
@@ -638,10 +1273,10 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 		return 0;
 	    }
 	    
-	    /* Remove the old region from the range list */
+	    /* Remove the old region from the range tree */
 	    remove_range(ranges, oldp);
 	    
-	    /* Check new block for correctness and add it to range list */
+	    /* Check new block for correctness and add it to range tree */
 	    if (add_range(ranges, newp, size, tracenum, i) == 0)
 		return 0;
 	    
@@ -653,7 +1288,7 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 	    oldsize = trace->block_sizes[index];
 	    if (size < oldsize) oldsize = size;
 	    for (j = 0; j < oldsize; j++) {
-	      if (newp[j] != (index & 0xFF)) {
+	      if ((unsigned char)newp[j] != (index & 0xFF)) {
 		malloc_error(tracenum, i, "mm_realloc did not preserve the "
 			     "data from old block");
 		return 0;
@@ -674,6 +1309,10 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 	    mm_free(p);
 	    break;
 
+	case SIGNAL: /* barriers order the threads of a multithreaded */
+	case WAIT:   /* trace, and a serial replay is already in order */
+	    break;
+
 	default:
 	    app_error("Nonexistent request type in eval_mm_valid");
         }
@@ -693,9 +1332,13 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
  *   package on the trace. Note that our implementation of mem_sbrk() 
  *   doesn't allow the students to decrement the brk pointer, so brk
  *   is always the high water mark of the heap. 
- *   
+ *
+ *   Along the way we record in stats the number of mem_sbrk calls and
+ *   the "tail", i.e., the bytes at the top of the heap that were never
+ *   covered by any payload (heap that was extended but never used).
  */
-static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
+static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges,
+			   stats_t *stats)
 {   
     int i;
     int index;
@@ -704,6 +1347,7 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
     int total_size = 0;
     char *p;
     char *newp, *oldp;
+    char *max_hi = (char *)mem_heap_lo() - 1; /* highest payload byte */
 
     /* initialize the heap and the mm malloc package */
     mem_reset_brk();
@@ -719,6 +1363,8 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 
 	    if ((p = mm_malloc(size)) == NULL) 
 		app_error("mm_malloc failed in eval_mm_util");
+	    if (p + size - 1 > max_hi)
+		max_hi = p + size - 1;
 	    
 	    /* Remember region and size */
 	    trace->blocks[index] = p;
@@ -741,6 +1387,8 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 	    oldp = trace->blocks[index];
 	    if ((newp = mm_realloc(oldp,newsize)) == NULL)
 		app_error("mm_realloc failed in eval_mm_util");
+	    if (newp + newsize - 1 > max_hi)
+		max_hi = newp + newsize - 1;
 
 	    /* Remember region and size */
 	    trace->blocks[index] = newp;
@@ -768,12 +1416,20 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 	    
 	    break;
 
+	case SIGNAL: /* barriers: a serial replay is already in order */
+	case WAIT:
+	    break;
+
 	default:
 	    app_error("Nonexistent request type in eval_mm_util");
 
         }
     }
 
+    stats->sbrks = mem_sbrk_calls();
+    stats->tail = (double)((char *)mem_heap_hi() - max_hi);
+    mm_get_stats(&stats->heap);
+
     return ((double)max_total_size / (double)mem_heapsize());
 }
 
@@ -820,11 +1476,486 @@ static void eval_mm_speed(void *ptr)
             mm_free(block);
             break;
 
+	case SIGNAL: /* barriers: a serial replay is already in order */
+	case WAIT:
+	    break;
+
 	default:
 	    app_error("Nonexistent request type in eval_mm_valid");
         }
 }
 
+/*
+ * The following routines replay a trace for timing like eval_mm_speed
+ * and eval_libc_speed, but also use the payloads the way a program
+ * would (-W), so that the times include the cache and TLB misses that
+ * the placement of the blocks causes. One byte in every touch.stride
+ * bytes of a payload is written or read.
+ */
+
+static volatile unsigned char touch_sink; /* keeps the reads */
+
+/*
+ * parse_touch - parse a -W spec, a list of write, read, sweep=<ops>
+ *     and stride=<bytes>, or "all" for write,read,sweep=1000
+ */
+static int parse_touch(char *spec)
+{
+    char *s, *tok;
+
+    if (strlen(spec) >= sizeof(touch.spec) || (s = strdup(spec)) == NULL)
+	return -1;
+    strcpy(touch.spec, spec);
+    for (tok = strtok(s, ","); tok != NULL; tok = strtok(NULL, ",")) {
+	if (!strcmp(tok, "all"))
+	    touch.write = touch.read = 1, touch.sweep = 1000;
+	else if (!strcmp(tok, "write"))
+	    touch.write = 1;
+	else if (!strcmp(tok, "read"))
+	    touch.read = 1;
+	else if (!strncmp(tok, "sweep=", 6) && atoi(tok + 6) > 0)
+	    touch.sweep = atoi(tok + 6);
+	else if (!strncmp(tok, "stride=", 7) && atoi(tok + 7) > 0)
+	    touch.stride = atoi(tok + 7);
+	else
+	    break;
+    }
+    free(s);
+    touching = 1;
+    return (tok == NULL) ? 0 : -1;
+}
+
+static inline void touch_write(char *p, size_t size)
+{
+    size_t off;
+
+    for (off = 0; off < size; off += touch.stride)
+	p[off] = (char)off;
+}
+
+static inline unsigned char touch_read(char *p, size_t size)
+{
+    unsigned char x = 0;
+    size_t off;
+
+    for (off = 0; off < size; off += touch.stride)
+	x += p[off];
+    return x;
+}
+
+/*
+ * replay_touch - replay the trace with the given allocator, touching
+ *     the payloads as set by -W
+ */
+static void replay_touch(speed_t *sp, void *(*alloc)(size_t),
+			 void *(*resize)(void *, size_t), void (*release)(void *))
+{
+    trace_t *trace = sp->trace;
+    int *live = sp->live, *livepos = sp->livepos;
+    size_t *sizes = sp->sizes;
+    int i, j, index, num_live = 0;
+    unsigned char x = 0;
+    char *p;
+
+    for (i = 0; i < trace->num_ops; i++) {
+	index = trace->ops[i].index;
+	switch (trace->ops[i].type) {
+	case ALLOC:
+	    if ((p = alloc(trace->ops[i].size)) == NULL)
+		app_error("malloc failed in replay_touch");
+	    trace->blocks[index] = p;
+	    sizes[index] = trace->ops[i].size;
+	    if (touch.write)
+		touch_write(p, sizes[index]);
+	    livepos[index] = num_live;
+	    live[num_live++] = index;
+	    break;
+
+	case REALLOC:
+	    if ((p = resize(trace->blocks[index], trace->ops[i].size)) == NULL)
+		app_error("realloc failed in replay_touch");
+	    trace->blocks[index] = p;
+	    sizes[index] = trace->ops[i].size;
+	    if (touch.write)
+		touch_write(p, sizes[index]);
+	    break;
+
+	case FREE:
+	    p = trace->blocks[index];
+	    if (touch.read)
+		x += touch_read(p, sizes[index]);
+	    release(p);
+	    j = livepos[index];
+	    live[j] = live[--num_live];
+	    livepos[live[j]] = j;
+	    break;
+
+	default:    /* barriers */
+	    break;
+	}
+
+	if (touch.sweep && (i + 1) % touch.sweep == 0)
+	    for (j = 0; j < num_live; j++)
+		x += touch_read(trace->blocks[live[j]], sizes[live[j]]);
+    }
+    touch_sink = x;
+}
+
+/*
+ * eval_mm_touch - eval_mm_speed, touching the payloads
+ */
+static void eval_mm_touch(void *ptr)
+{
+    mem_reset_brk();
+    if (mm_init() < 0) 
+	app_error("mm_init failed in eval_mm_touch");
+    replay_touch((speed_t *)ptr, mm_malloc, mm_realloc, mm_free);
+}
+
+/*
+ * eval_libc_touch - eval_libc_speed, touching the payloads
+ */
+static void eval_libc_touch(void *ptr)
+{
+    replay_touch((speed_t *)ptr, malloc, realloc, free);
+}
+
+/*
+ * The following routines time every request of the mm package (-L), to
+ * find the slow ones (a heap extension, a long free list walk) that an
+ * average over the whole trace hides. Each call is bracketed by clock
+ * reads, and the cost of a pair of reads is subtracted.
+ */
+
+#define LAT_RUNS 10  /* replays per trace, for more samples */
+
+static inline uint64_t clock_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * clock_overhead - the least time between two clock reads, which is
+ *     what we subtract (so a latency is never made too small)
+ */
+static uint64_t clock_overhead(void)
+{
+    uint64_t t0, t1, min = UINT64_MAX;
+    int i;
+
+    for (i = 0; i < 100000; i++) {
+	t0 = clock_ns();
+	t1 = clock_ns();
+	if (t1 - t0 < min)
+	    min = t1 - t0;
+    }
+    return min;
+}
+
+/*
+ * eval_mm_latency - replay the trace LAT_RUNS times, adding the
+ *     latency of every request to the histograms of stats; returns the
+ *     p99 latency of all the requests of these replays
+ */
+static double eval_mm_latency(trace_t *trace, stats_t *stats)
+{
+    static lhist_t all;
+    int i, run, index;
+    traceop_t *op;
+    uint64_t t0, t1, ns;
+    char *p;
+
+    lhist_reset(&all);
+
+    for (run = 0; run < LAT_RUNS; run++) {
+	mem_reset_brk();
+	if (mm_init() < 0)
+	    app_error("mm_init failed in eval_mm_latency");
+
+	for (i = 0; i < trace->num_ops; i++) {
+	    op = &trace->ops[i];
+	    index = op->index;
+	    switch (op->type) {
+
+	    case ALLOC: /* mm_malloc */
+		t0 = clock_ns();
+		p = mm_malloc(op->size);
+		t1 = clock_ns();
+		if (p == NULL)
+		    app_error("mm_malloc error in eval_mm_latency");
+		trace->blocks[index] = p;
+		break;
+
+	    case REALLOC: /* mm_realloc */
+		t0 = clock_ns();
+		p = mm_realloc(trace->blocks[index], op->size);
+		t1 = clock_ns();
+		if (p == NULL)
+		    app_error("mm_realloc error in eval_mm_latency");
+		trace->blocks[index] = p;
+		break;
+
+	    case FREE: /* mm_free */
+		t0 = clock_ns();
+		mm_free(trace->blocks[index]);
+		t1 = clock_ns();
+		break;
+
+	    default:    /* barriers */
+		continue;
+	    }
+	    ns = (t1 - t0 > lat_overhead) ? t1 - t0 - lat_overhead : 0;
+	    lhist_record(&stats->lat[op->type], ns);
+	    lhist_record(&all, ns);
+	}
+    }
+    return (double)lhist_percentile(&all, 99);
+}
+
+/*
+ * The following routines replay a streamed trace (-S), which never has
+ * to fit in memory. The blocks of a streamed trace are found through a
+ * hash map keyed by the 64-bit block id, which only holds the blocks
+ * that are live, instead of the trace's blocks[] and block_sizes[].
+ */
+
+#define NO_ID UINT64_MAX   /* marks an empty slot of the id map */
+
+/* A live block of a streamed trace */
+typedef struct {
+    uint64_t id;           /* block id, or NO_ID */
+    char *p;               /* payload address */
+    size_t size;           /* payload size */
+} idslot_t;
+
+static idslot_t *idmap = NULL;  /* open addressing, linear probing */
+static size_t idmap_cap = 0;    /* slots (a power of 2) */
+static size_t idmap_used = 0;   /* live blocks */
+
+static size_t idmap_hash(uint64_t id)
+{
+    uint64_t h = id * 0x9E3779B97F4A7C15ULL;
+    return (size_t)(h ^ (h >> 32)) & (idmap_cap - 1);
+}
+
+/*
+ * idmap_reset - empty the id map
+ */
+static void idmap_reset(void)
+{
+    size_t i;
+
+    if (idmap == NULL) {
+	idmap_cap = 1024;
+	if ((idmap = (idslot_t *)malloc(idmap_cap * sizeof(idslot_t))) == NULL)
+	    unix_error("malloc failed in idmap_reset");
+    }
+    for (i = 0; i < idmap_cap; i++)
+	idmap[i].id = NO_ID;
+    idmap_used = 0;
+}
+
+/*
+ * idmap_find - the slot of block id, or NULL if it isn't live
+ */
+static idslot_t *idmap_find(uint64_t id)
+{
+    size_t i;
+
+    for (i = idmap_hash(id); idmap[i].id != NO_ID; i = (i + 1) & (idmap_cap - 1))
+	if (idmap[i].id == id)
+	    return &idmap[i];
+    return NULL;
+}
+
+/*
+ * idmap_insert - add block id (which must not be live), growing the
+ *     map to keep it at most half full
+ */
+static void idmap_insert(uint64_t id, char *p, size_t size)
+{
+    idslot_t *old = idmap;
+    size_t old_cap = idmap_cap, i;
+
+    if (2 * (idmap_used + 1) > idmap_cap) {
+	idmap_cap *= 2;
+	if ((idmap = (idslot_t *)malloc(idmap_cap * sizeof(idslot_t))) == NULL)
+	    unix_error("malloc failed in idmap_insert");
+	for (i = 0; i < idmap_cap; i++)
+	    idmap[i].id = NO_ID;
+	idmap_used = 0;
+	for (i = 0; i < old_cap; i++)
+	    if (old[i].id != NO_ID)
+		idmap_insert(old[i].id, old[i].p, old[i].size);
+	free(old);
+    }
+
+    for (i = idmap_hash(id); idmap[i].id != NO_ID; i = (i + 1) & (idmap_cap - 1))
+	;
+    idmap[i].id = id;
+    idmap[i].p = p;
+    idmap[i].size = size;
+    idmap_used++;
+}
+
+/*
+ * idmap_remove - remove a slot, shifting back the slots of the probe
+ *     sequence behind it so that no tombstones are needed
+ */
+static void idmap_remove(idslot_t *slot)
+{
+    size_t mask = idmap_cap - 1;
+    size_t hole = slot - idmap, i, home;
+
+    for (i = (hole + 1) & mask; idmap[i].id != NO_ID; i = (i + 1) & mask) {
+	home = idmap_hash(idmap[i].id);
+	/* move slot i into the hole unless its home lies in (hole, i] */
+	if (((i - home) & mask) >= ((i - hole) & mask)) {
+	    idmap[hole] = idmap[i];
+	    hole = i;
+	}
+    }
+    idmap[hole].id = NO_ID;
+    idmap_used--;
+}
+
+/*
+ * eval_mm_stream - Check the mm malloc package for correctness and
+ *     measure its space utilization on a streamed trace, in one pass.
+ *     The secs recorded in stats are for that pass, checks included.
+ */
+static int eval_mm_stream(char *tracedir, char *filename, int tracenum,
+			  range_t **ranges, stats_t *stats)
+{
+    trace_stream_t *stream;
+    streamop_t *ops, *op;
+    idslot_t *slot;
+    uint64_t num_ids, num_ops, opnum = 0;
+    size_t n, i, j, oldsize;
+    size_t total_size = 0, max_total_size = 0;
+    char *p, *newp, *oldp;
+    char *max_hi = (char *)mem_heap_lo() - 1; /* highest payload byte */
+    struct timespec start, end;
+    int valid = 1;
+
+    /* Reset the heap and free any records in the range tree */
+    mem_reset_brk();
+    clear_ranges(ranges);
+    idmap_reset();
+
+    /* Call the mm package's init function */
+    if (mm_init() < 0) {
+	malloc_error(tracenum, 0, "mm_init failed.");
+	return 0;
+    }
+
+    stream = open_trace_stream(tracedir, filename, &num_ids, &num_ops);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    while (valid && (n = read_trace_stream(stream, &ops)) > 0) {
+	for (i = 0; valid && i < n; i++, opnum++) {
+	    op = &ops[i];
+	    switch (op->type) {
+
+	    case ALLOC: /* mm_malloc */
+		if (idmap_find(op->index) != NULL) {
+		    malloc_error(tracenum, opnum, "block id is already in use");
+		    valid = 0;
+		    break;
+		}
+		if ((p = mm_malloc(op->size)) == NULL) {
+		    malloc_error(tracenum, opnum, "mm_malloc failed.");
+		    valid = 0;
+		    break;
+		}
+		if (add_range(ranges, p, op->size, tracenum, opnum) == 0) {
+		    valid = 0;
+		    break;
+		}
+		memset(p, op->index & 0xFF, op->size);
+		idmap_insert(op->index, p, op->size);
+		if (p + op->size - 1 > max_hi)
+		    max_hi = p + op->size - 1;
+		total_size += op->size;
+		break;
+
+	    case REALLOC: /* mm_realloc */
+		if ((slot = idmap_find(op->index)) == NULL) {
+		    malloc_error(tracenum, opnum, "realloc of a block id that isn't live");
+		    valid = 0;
+		    break;
+		}
+		oldp = slot->p;
+		oldsize = slot->size;
+		if ((newp = mm_realloc(oldp, op->size)) == NULL) {
+		    malloc_error(tracenum, opnum, "mm_realloc failed.");
+		    valid = 0;
+		    break;
+		}
+		remove_range(ranges, oldp);
+		if (add_range(ranges, newp, op->size, tracenum, opnum) == 0) {
+		    valid = 0;
+		    break;
+		}
+		if (op->size < oldsize)
+		    oldsize = op->size;
+		for (j = 0; j < oldsize; j++) {
+		    if ((unsigned char)newp[j] != (op->index & 0xFF)) {
+			malloc_error(tracenum, opnum, "mm_realloc did not preserve the "
+				     "data from old block");
+			valid = 0;
+			break;
+		    }
+		}
+		memset(newp, op->index & 0xFF, op->size);
+		if (newp + op->size - 1 > max_hi)
+		    max_hi = newp + op->size - 1;
+		total_size += op->size;
+		total_size -= slot->size;
+		slot->p = newp;
+		slot->size = op->size;
+		break;
+
+	    case FREE: /* mm_free */
+		if ((slot = idmap_find(op->index)) == NULL) {
+		    malloc_error(tracenum, opnum, "free of a block id that isn't live");
+		    valid = 0;
+		    break;
+		}
+		remove_range(ranges, slot->p);
+		mm_free(slot->p);
+		total_size -= slot->size;
+		idmap_remove(slot);
+		break;
+
+	    case SIGNAL: /* barriers: a serial replay is already in order */
+	    case WAIT:
+		break;
+
+	    default:
+		app_error("Nonexistent request type in eval_mm_stream");
+	    }
+	    if (total_size > max_total_size)
+		max_total_size = total_size;
+	}
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    close_trace_stream(stream);
+
+    stats->ops = (double)opnum;
+    stats->secs = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    stats->util = (double)max_total_size / (double)mem_heapsize();
+    stats->sbrks = mem_sbrk_calls();
+    stats->tail = (double)((char *)mem_heap_hi() - max_hi);
+    mm_get_stats(&stats->heap);
+    return valid;
+}
+
+
 /*
  * eval_libc_valid - We run this function to make sure that the
  *    libc malloc can run to completion on the set of traces.
@@ -861,6 +1992,10 @@ static int eval_libc_valid(trace_t *trace, int tracenum)
 	    free(trace->blocks[trace->ops[i].index]);
 	    break;
 
+	case SIGNAL: /* barriers: a serial replay is already in order */
+	case WAIT:
+	    break;
+
 	default:
 	    app_error("invalid operation type  in eval_libc_valid");
 	}
@@ -906,6 +2041,10 @@ static void eval_libc_speed(void *ptr)
 	    block = trace->blocks[index];
 	    free(block);
 	    break;
+
+	case SIGNAL: /* barriers: a serial replay is already in order */
+	case WAIT:
+	    break;
 	}
     }
 }
@@ -924,53 +2063,898 @@ static void printresults(int n, stats_t *stats)
     double secs = 0;
     double ops = 0;
     double util = 0;
+    double sbrks = 0;
+    double tail = 0;
+    double spread = -1;
+    char sd[16];
 
     /* Print the individual results for each trace */
-    printf("%5s%7s %5s%8s%10s%6s\n", 
-	   "trace", " valid", "util", "ops", "secs", "Kops");
+    printf("%5s%7s %5s%8s%10s%6s%9s%7s%8s\n", 
+	   "trace", " valid", "util", "ops", "secs", "+-%", "Kops", "sbrk", "tail");
     for (i=0; i < n; i++) {
 	if (stats[i].valid) {
-	    printf("%2d%10s%5.0f%%%8.0f%10.6f%6.0f\n", 
+	    if (stats[i].spread < 0)
+		strcpy(sd, "-");
+	    else
+		sprintf(sd, "%.1f", stats[i].spread*100.0);
+	    printf("%2d%10s%5.0f%%%8.0f%10.6f%6s%9.0f%7d%8.0f\n", 
 		   i,
 		   "yes",
 		   stats[i].util*100.0,
 		   stats[i].ops,
 		   stats[i].secs,
-		   (stats[i].ops/1e3)/stats[i].secs);
+		   sd,
+		   (stats[i].ops/1e3)/stats[i].secs,
+		   stats[i].sbrks,
+		   stats[i].tail);
+	    if (stats[i].spread > spread)
+		spread = stats[i].spread;
 	    secs += stats[i].secs;
 	    ops += stats[i].ops;
 	    util += stats[i].util;
+	    sbrks += stats[i].sbrks;
+	    tail += stats[i].tail;
 	}
 	else {
-	    printf("%2d%10s%6s%8s%10s%6s\n", 
+	    printf("%2d%10s%6s%8s%10s%6s%9s%7s%8s\n", 
 		   i,
 		   "no",
 		   "-",
 		   "-",
 		   "-",
+		   "-",
+		   "-",
+		   "-",
 		   "-");
 	}
     }
 
-    /* Print the aggregate results for the set of traces */
+    /* Print the aggregate results; the spread is the worst trace's */
     if (errors == 0) {
-	printf("%12s%5.0f%%%8.0f%10.6f%6.0f\n", 
+	if (spread < 0)
+	    strcpy(sd, "-");
+	else
+	    sprintf(sd, "%.1f", spread*100.0);
+	printf("%12s%5.0f%%%8.0f%10.6f%6s%9.0f%7.0f%8.0f\n", 
 	       "Total       ",
 	       (util/n)*100.0,
 	       ops, 
 	       secs,
-	       (ops/1e3)/secs);
+	       sd,
+	       (ops/1e3)/secs,
+	       sbrks,
+	       tail);
     }
     else {
-	printf("%12s%6s%8s%10s%6s\n", 
+	printf("%12s%6s%8s%10s%6s%9s%7s%8s\n", 
 	       "Total       ",
 	       "-", 
 	       "-", 
 	       "-", 
+	       "-",
+	       "-",
+	       "-",
 	       "-");
     }
 
+#ifdef MM_STATS
+    /* Explain the numbers with the allocator's search counters */
+    for (i=0; i < n; i++) {
+	if (stats[i].heap.find_calls > 0) {
+	    printcounters(n, stats);
+	    break;
+	}
+    }
+#endif
+}
+
+/*
+ * printlatency - prints the latency percentiles of each request type,
+ *     for each trace and over all the traces
+ */
+static void printlatency(int n, stats_t *stats)
+{
+    static char *names[3] = {"malloc", "free", "realloc"};
+    lhist_t *all;
+    int i, t;
+
+    if ((all = (lhist_t *)calloc(3, sizeof(lhist_t))) == NULL)
+	unix_error("calloc failed in printlatency");
+
+    printf("Latency of mm requests (ns, less %llu ns of clock overhead):\n",
+	   (unsigned long long)lat_overhead);
+    printf("%5s %-8s%10s%8s%8s%8s%8s%10s\n",
+	   "trace", "request", "count", "p50", "p90", "p99", "p999", "max");
+    for (i=0; i <= n; i++) {
+	for (t = 0; t < 3; t++) {
+	    lhist_t *h = (i < n) ? &stats[i].lat[t] : &all[t];
+
+	    if (i < n)
+		lhist_merge(&all[t], h);
+	    if (h->n == 0)
+		continue;
+	    if (i < n)
+		printf("%2d    ", i);
+	    else
+		printf("%-6s", "Total");
+	    printf("%-8s%10llu%8llu%8llu%8llu%8llu%10llu\n", names[t],
+		   (unsigned long long)h->n,
+		   (unsigned long long)lhist_percentile(h, 50),
+		   (unsigned long long)lhist_percentile(h, 90),
+		   (unsigned long long)lhist_percentile(h, 99),
+		   (unsigned long long)lhist_percentile(h, 99.9),
+		   (unsigned long long)h->max);
+	}
+    }
+    free(all);
+}
+
+/*
+ * printperf - prints the hardware events of a speed run of each trace,
+ *     per request ("-" for the counters that couldn't be opened)
+ */
+static void printperf(int n, stats_t *stats)
+{
+    static char *heads[PERF_COUNTERS] = {
+	"cyc/op", "ins/op", "L1D/op", "LLC/op", "dTLB/op", "brmis/op"
+    };
+    char buf[16];
+    int i, j;
+
+    printf("Hardware events of mm requests (per request, one run):\n");
+    printf("%5s%8s", "trace", "Kops");
+    for (j = 0; j < PERF_COUNTERS; j++)
+	printf("%9s", heads[j]);
+    printf("%6s\n", "IPC");
+    for (i = 0; i < n; i++) {
+	if (!stats[i].valid)
+	    continue;
+	printf("%2d%11.0f", i, (stats[i].ops/1e3)/stats[i].secs);
+	for (j = 0; j < PERF_COUNTERS; j++) {
+	    if (stats[i].perf[j] < 0)
+		strcpy(buf, "-");
+	    else
+		sprintf(buf, "%.*f", (j <= PERF_INSTRUCTIONS) ? 0 : 2,
+			stats[i].perf[j] / stats[i].ops);
+	    printf("%9s", buf);
+	}
+	if (stats[i].perf[PERF_CYCLES] > 0 && stats[i].perf[PERF_INSTRUCTIONS] >= 0)
+	    printf("%6.2f\n", stats[i].perf[PERF_INSTRUCTIONS] /
+		   stats[i].perf[PERF_CYCLES]);
+	else
+	    printf("%6s\n", "-");
+    }
+}
+
+/*
+ * The JSON and CSV reports (--format). They carry every field of the
+ * stats of each trace, the totals, and enough about the host, the build
+ * and the timer to compare results from different machines. Values that
+ * aren't known are null in JSON and empty in CSV.
+ */
+
+static char *lat_names[3] = {"malloc", "free", "realloc"};
+
+/* Host and build metadata */
+typedef struct {
+    struct utsname uts;
+    char timestamp[32];
+    char *timer;
+    int k;
+} meta_t;
+
+static void get_meta(meta_t *m)
+{
+    time_t now = time(NULL);
+
+    if (uname(&m->uts) < 0)
+	memset(&m->uts, 0, sizeof(m->uts));
+    strftime(m->timestamp, sizeof(m->timestamp), "%Y-%m-%dT%H:%M:%SZ",
+	     gmtime(&now));
+    m->timer = fsecs_timer(&m->k);
+}
+
+/* Totals over the valid traces of one allocator */
+typedef struct {
+    int valid;       /* every trace was valid */
+    double ops, secs, util, sbrks, tail;
+} total_t;
+
+static void get_total(int n, stats_t *stats, total_t *t)
+{
+    int i;
+
+    memset(t, 0, sizeof(*t));
+    t->valid = 1;
+    for (i = 0; i < n; i++) {
+	if (!stats[i].valid) {
+	    t->valid = 0;
+	    continue;
+	}
+	t->ops += stats[i].ops;
+	t->secs += stats[i].secs;
+	t->util += stats[i].util;
+	t->sbrks += stats[i].sbrks;
+	t->tail += stats[i].tail;
+    }
+    t->util /= n;
+}
+
+/* json_string - write s as a JSON string */
+static void json_string(FILE *out, const char *s)
+{
+    putc('"', out);
+    for (; *s; s++) {
+	if (*s == '"' || *s == '\\')
+	    fprintf(out, "\\%c", *s);
+	else if ((unsigned char)*s < 0x20)
+	    fprintf(out, "\\u%04x", *s);
+	else
+	    putc(*s, out);
+    }
+    putc('"', out);
+}
+
+/* json_number - write x, or null if it isn't a finite number */
+static void json_number(FILE *out, double x)
+{
+    if (isfinite(x))
+	fprintf(out, "%.9g", x);
+    else
+	fprintf(out, "null");
+}
+
+static void json_ulongs(FILE *out, unsigned long *a, int n)
+{
+    int i;
+
+    for (i = 0; i < n; i++)
+	fprintf(out, "%s%lu", i ? ", " : "[", a[i]);
+    fprintf(out, "]");
+}
+
+static void json_doubles(FILE *out, double *a, int n)
+{
+    int i;
+
+    for (i = 0; i < n; i++) {
+	fprintf(out, i ? ", " : "[");
+	json_number(out, a[i]);
+    }
+    fprintf(out, "]");
+}
+
+/* json_stats - write the stats of one trace of an allocator */
+static void json_stats(FILE *out, int i, char *file, stats_t *st, int mm)
+{
+    struct mm_stats *h = &st->heap;
+    int t, b;
+
+    fprintf(out, "        {\"trace\": %d, \"file\": ", i);
+    json_string(out, file);
+    fprintf(out, ", \"valid\": %s", st->valid ? "true" : "false");
+    if (!st->valid) {
+	fprintf(out, "}");
+	return;
+    }
+    fprintf(out, ", \"ops\": %.0f, \"secs\": ", st->ops);
+    json_number(out, st->secs);
+    fprintf(out, ", \"spread\": ");
+    json_number(out, st->spread < 0 ? 0.0 / 0.0 : st->spread);
+    fprintf(out, ", \"kops\": ");
+    json_number(out, st->ops / 1e3 / st->secs);
+    if (st->num_samples > 1) {
+	fprintf(out, ", \"secs_samples\": ");
+	json_doubles(out, st->secs_samples, st->num_samples);
+	if (mm && latency) {
+	    fprintf(out, ", \"p99_samples\": ");
+	    json_doubles(out, st->p99_samples, st->num_samples);
+	}
+    }
+    if (mm) {
+	fprintf(out, ", \"util\": ");
+	json_number(out, st->util);
+	fprintf(out, ", \"sbrks\": %d, \"tail\": %.0f", st->sbrks, st->tail);
+	fprintf(out, ",\n         \"heap\": {\"heap_size\": %lu, \"live_bytes\": %lu, "
+		"\"wilderness_bytes\": %lu, \"largest_free\": %lu, "
+		"\"ext_fragmentation\": ",
+		(unsigned long)h->heap_size, (unsigned long)h->live_bytes,
+		(unsigned long)h->wilderness_bytes, (unsigned long)h->largest_free);
+	json_number(out, h->ext_fragmentation);
+	fprintf(out, ", \"sbrk_calls\": %lu, \"free_bytes\": ", h->sbrk_calls);
+	for (b = 0; b < MM_STATS_BINS; b++)
+	    fprintf(out, "%s%lu", b ? ", " : "[", (unsigned long)h->free_bytes[b]);
+	fprintf(out, "],\n                  \"mallocs\": %lu, \"frees\": %lu, "
+		"\"splits\": %lu, \"coalesces\": %lu, \"find_calls\": %lu, "
+		"\"find_nodes\": %lu, \"find_misses\": %lu,\n"
+		"                  \"find_nodes_hist\": ",
+		h->mallocs, h->frees, h->splits, h->coalesces, h->find_calls,
+		h->find_nodes, h->find_misses);
+	json_ulongs(out, h->find_nodes_hist, MM_HIST_BUCKETS);
+	fprintf(out, ", \"find_bins_hist\": ");
+	json_ulongs(out, h->find_bins_hist, MM_HIST_BUCKETS);
+	fprintf(out, "}");
+	if (counters) {
+	    fprintf(out, ",\n         \"counters\": {");
+	    for (t = 0; t < PERF_COUNTERS; t++) {
+		fprintf(out, "%s\"%s\": ", t ? ", " : "", perf_names[t]);
+		json_number(out, st->perf[t] < 0 ? 0.0 / 0.0 : st->perf[t]);
+	    }
+	    fprintf(out, "}");
+	}
+	if (latency) {
+	    fprintf(out, ",\n         \"latency_ns\": {");
+	    for (t = 0; t < 3; t++)
+		fprintf(out, "%s\"%s\": {\"count\": %llu, \"p50\": %llu, "
+			"\"p90\": %llu, \"p99\": %llu, \"p999\": %llu, "
+			"\"max\": %llu}", t ? ", " : "", lat_names[t],
+			(unsigned long long)st->lat[t].n,
+			(unsigned long long)lhist_percentile(&st->lat[t], 50),
+			(unsigned long long)lhist_percentile(&st->lat[t], 90),
+			(unsigned long long)lhist_percentile(&st->lat[t], 99),
+			(unsigned long long)lhist_percentile(&st->lat[t], 99.9),
+			(unsigned long long)st->lat[t].max);
+	    fprintf(out, "}");
+	}
+    }
+    fprintf(out, "}");
+}
+
+/* json_allocator - write the stats of one allocator on all the traces */
+static void json_allocator(FILE *out, char *name, char **tracefiles, int n,
+			   stats_t *stats, double perfindex)
+{
+    total_t t;
+    int i, mm = !strcmp(name, "mm");
+
+    get_total(n, stats, &t);
+    fprintf(out, "    {\"name\": \"%s\"", name);
+    if (mm) {
+	fprintf(out, ", \"team\": ");
+	json_string(out, team.teamname);
+    }
+    fprintf(out, ",\n     \"traces\": [\n");
+    for (i = 0; i < n; i++) {
+	json_stats(out, i, tracefiles[i], &stats[i], mm);
+	fprintf(out, "%s\n", (i < n - 1) ? "," : "");
+    }
+    fprintf(out, "     ],\n     \"total\": {\"valid\": %s", t.valid ? "true" : "false");
+    if (t.valid) {
+	fprintf(out, ", \"ops\": %.0f, \"secs\": ", t.ops);
+	json_number(out, t.secs);
+	fprintf(out, ", \"kops\": ");
+	json_number(out, t.ops / 1e3 / t.secs);
+	if (mm) {
+	    fprintf(out, ", \"util\": ");
+	    json_number(out, t.util);
+	    fprintf(out, ", \"sbrks\": %.0f, \"tail\": %.0f", t.sbrks, t.tail);
+	}
+    }
+    if (mm) {
+	fprintf(out, ", \"perfindex\": ");
+	json_number(out, perfindex < 0 ? 0.0 / 0.0 : perfindex);
+    }
+    fprintf(out, "}}");
+}
+
+static void printjson(FILE *out, char **tracefiles, int n, int jobs,
+		      int stream, stats_t *libc_stats, stats_t *mm_stats,
+		      double perfindex)
+{
+    meta_t m;
+
+    get_meta(&m);
+    fprintf(out, "{\n  \"timestamp\": \"%s\",\n  \"host\": {\"name\": ", m.timestamp);
+    json_string(out, m.uts.nodename);
+    fprintf(out, ", \"os\": ");
+    json_string(out, m.uts.sysname);
+    fprintf(out, ", \"release\": ");
+    json_string(out, m.uts.release);
+    fprintf(out, ", \"machine\": ");
+    json_string(out, m.uts.machine);
+    fprintf(out, ", \"cpus\": %ld},\n  \"build\": {\"compiler\": ",
+	    sysconf(_SC_NPROCESSORS_ONLN));
+    json_string(out, __VERSION__);
+    fprintf(out, ", \"cflags\": ");
+    json_string(out, BUILD_CFLAGS);
+#ifdef MM_STATS
+    fprintf(out, ", \"pointer_bits\": %d, \"mm_stats\": true},\n",
+	    (int)(8 * sizeof(void *)));
+#else
+    fprintf(out, ", \"pointer_bits\": %d, \"mm_stats\": false},\n",
+	    (int)(8 * sizeof(void *)));
+#endif
+    fprintf(out, "  \"run\": {\"timer\": \"%s\", \"k\": %d, \"jobs\": %d, "
+	    "\"streamed\": %s, \"latency\": %s, \"tracedir\": ", m.timer, m.k,
+	    jobs, stream ? "true" : "false", latency ? "true" : "false");
+    json_string(out, tracedir);
+    fprintf(out, ", \"touch\": ");
+    if (touching)
+	json_string(out, touch.spec);
+    else
+	fprintf(out, "null");
+    fprintf(out, ", \"reference_kops\": ");
+    json_number(out, ref_thruput / 1e3);
+    fprintf(out, ", \"reference\": \"%s\", \"capped\": %s", ref_source,
+	    capped ? "true" : "false");
+    fprintf(out, ", \"errors\": %d},\n  \"allocators\": [\n", errors);
+    json_allocator(out, "mm", tracefiles, n, mm_stats, perfindex);
+    if (libc_stats) {
+	fprintf(out, ",\n");
+	json_allocator(out, "libc", tracefiles, n, libc_stats, -1);
+    }
+    fprintf(out, "\n  ]\n}\n");
+}
+
+/* csv_string - write s as a CSV field, quoted if it has to be */
+static void csv_string(FILE *out, const char *s)
+{
+    if (strpbrk(s, ",\"\n\r") == NULL) {
+	fputs(s, out);
+	return;
+    }
+    putc('"', out);
+    for (; *s; s++) {
+	if (*s == '"')
+	    putc('"', out);
+	putc(*s, out);
+    }
+    putc('"', out);
+}
+
+/* csv_number - write x, or nothing if it isn't known */
+static void csv_number(FILE *out, double x)
+{
+    if (isfinite(x))
+	fprintf(out, ",%.9g", x);
+    else
+	fprintf(out, ",");
+}
+
+/* csv_rows - write a row per trace, and a total row, for one allocator */
+static void csv_rows(FILE *out, meta_t *m, char *name, char **tracefiles,
+		     int n, stats_t *stats, double perfindex)
+{
+    double nan = 0.0 / 0.0;
+    struct mm_stats *h;
+    stats_t *st;
+    total_t t;
+    int i, k, mm = !strcmp(name, "mm");
+
+    get_total(n, stats, &t);
+    for (i = 0; i <= n; i++) {
+	st = &stats[i < n ? i : 0];
+	h = &st->heap;
+
+	/* Where and how it ran */
+	csv_string(out, m->uts.nodename);
+	putc(',', out);
+	csv_string(out, m->uts.machine);
+	putc(',', out);
+	csv_string(out, __VERSION__);
+	putc(',', out);
+	csv_string(out, BUILD_CFLAGS);
+	fprintf(out, ",%s,%d,%s,%s,", m->timer, m->k, m->timestamp, name);
+	csv_string(out, mm ? team.teamname : "");
+
+	if (i == n) {  /* the total row */
+	    fprintf(out, ",total,,%d", t.valid);
+	    if (!t.valid) {
+		fprintf(out, ",,,,");
+	    } else {
+		fprintf(out, ",%.0f", t.ops);
+		csv_number(out, t.secs);
+		csv_number(out, nan);
+		csv_number(out, t.ops / 1e3 / t.secs);
+	    }
+	    csv_number(out, mm && t.valid ? t.util : nan);
+	    csv_number(out, mm && t.valid ? t.sbrks : nan);
+	    csv_number(out, mm && t.valid ? t.tail : nan);
+	    fprintf(out, ",,,,,,,,,,,,");
+	    for (k = 0; k < 3 * 6; k++)
+		putc(',', out);
+	    csv_number(out, mm && perfindex >= 0 ? perfindex : nan);
+	    fprintf(out, ",,");
+	    for (k = 0; k < PERF_COUNTERS; k++)
+		putc(',', out);
+	    putc('\n', out);
+	    continue;
+	}
+
+	fprintf(out, ",%d,", i);
+	csv_string(out, tracefiles[i]);
+	fprintf(out, ",%d", st->valid);
+	if (!st->valid) {
+	    /* 4 timing, 3 util, 12 heap, 18 latency, perfindex, samples, events */
+	    for (k = 0; k < 4 + 3 + 12 + 18 + 1 + 2 + PERF_COUNTERS; k++)
+		putc(',', out);
+	    putc('\n', out);
+	    continue;
+	}
+	fprintf(out, ",%.0f", st->ops);
+	csv_number(out, st->secs);
+	csv_number(out, st->spread < 0 ? nan : st->spread);
+	csv_number(out, st->ops / 1e3 / st->secs);
+	if (mm) {
+	    csv_number(out, st->util);
+	    fprintf(out, ",%d,%.0f", st->sbrks, st->tail);
+	    fprintf(out, ",%lu,%lu,%lu,%lu", (unsigned long)h->heap_size,
+		    (unsigned long)h->live_bytes, (unsigned long)h->wilderness_bytes,
+		    (unsigned long)h->largest_free);
+	    csv_number(out, h->ext_fragmentation);
+	    fprintf(out, ",%lu,%lu,%lu,%lu,%lu,%lu,%lu", h->mallocs, h->frees,
+		    h->splits, h->coalesces, h->find_calls, h->find_nodes,
+		    h->find_misses);
+	} else {
+	    for (k = 0; k < 3 + 12; k++)
+		putc(',', out);
+	}
+	for (k = 0; k < 3; k++) {
+	    if (mm && latency)
+		fprintf(out, ",%llu,%llu,%llu,%llu,%llu,%llu",
+			(unsigned long long)st->lat[k].n,
+			(unsigned long long)lhist_percentile(&st->lat[k], 50),
+			(unsigned long long)lhist_percentile(&st->lat[k], 90),
+			(unsigned long long)lhist_percentile(&st->lat[k], 99),
+			(unsigned long long)lhist_percentile(&st->lat[k], 99.9),
+			(unsigned long long)st->lat[k].max);
+	    else
+		fprintf(out, ",,,,,,");
+	}
+
+	/* perfindex is only in the total row; the samples are space-separated */
+	fprintf(out, ",,");
+	for (k = 0; k < st->num_samples; k++)
+	    fprintf(out, "%s%.9g", k ? " " : "", st->secs_samples[k]);
+	putc(',', out);
+	for (k = 0; mm && latency && k < st->num_samples; k++)
+	    fprintf(out, "%s%.0f", k ? " " : "", st->p99_samples[k]);
+	for (k = 0; k < PERF_COUNTERS; k++)
+	    csv_number(out, mm && counters && st->perf[k] >= 0 ? st->perf[k] : nan);
+	putc('\n', out);
+    }
+}
+
+static void printcsv(FILE *out, char **tracefiles, int n,
+		     stats_t *libc_stats, stats_t *mm_stats, double perfindex)
+{
+    meta_t m;
+    int t;
+
+    get_meta(&m);
+    fprintf(out, "host,machine,compiler,cflags,timer,k,timestamp,allocator,"
+	    "team,trace,file,valid,ops,secs,spread,kops,util,sbrks,tail,"
+	    "heap_size,live_bytes,wilderness_bytes,largest_free,"
+	    "ext_fragmentation,mallocs,frees,splits,coalesces,find_calls,"
+	    "find_nodes,find_misses");
+    for (t = 0; t < 3; t++)
+	fprintf(out, ",%s_count,%s_p50,%s_p90,%s_p99,%s_p999,%s_max",
+		lat_names[t], lat_names[t], lat_names[t], lat_names[t],
+		lat_names[t], lat_names[t]);
+    fprintf(out, ",perfindex,secs_samples,p99_samples");
+    for (t = 0; t < PERF_COUNTERS; t++)
+	fprintf(out, ",%s", perf_names[t]);
+    putc('\n', out);
+    csv_rows(out, &m, "mm", tracefiles, n, mm_stats, perfindex);
+    if (libc_stats)
+	csv_rows(out, &m, "libc", tracefiles, n, libc_stats, -1);
+}
+
+/*
+ * printreport - write the JSON or CSV report
+ */
+static void printreport(FILE *out, char **tracefiles, int n, int jobs,
+			int stream, stats_t *libc_stats, stats_t *mm_stats,
+			double perfindex)
+{
+    if (format == FORMAT_JSON)
+	printjson(out, tracefiles, n, jobs, stream, libc_stats, mm_stats,
+		  perfindex);
+    else
+	printcsv(out, tracefiles, n, libc_stats, mm_stats, perfindex);
+    if (fclose(out) != 0)
+	unix_error("Could not write the report");
+}
+
+/*
+ * The calibration file (-c) keeps the libc throughput of each host on
+ * each set of traces, one "<key> <ops/sec>" line each; the last line of
+ * a key counts. The key is the host name, a hash of the trace names, and
+ * what changes the measurement: the timer and its K, and the -W spec
+ * ("-" without -W), e.g. "host:658e...:clock:3:-".
+ */
+static char *calibration_key(char **tracefiles)
+{
+    static char key[MAXLINE];
+    char host[256], spec[sizeof(touch.spec)];
+    uint64_t h = 0xcbf29ce484222325ULL;  /* FNV-1a */
+    char *p, *timer;
+    int i, k;
+
+    if (gethostname(host, sizeof(host)) < 0)
+	strcpy(host, "unknown");
+    host[sizeof(host) - 1] = '\0';
+    for (i = 0; tracefiles[i] != NULL; i++)
+	for (p = tracefiles[i]; ; p++) {
+	    h = (h ^ (unsigned char)*p) * 0x100000001b3ULL;
+	    if (*p == '\0')
+		break;
+	}
+    strcpy(spec, touching ? touch.spec : "-");
+    for (p = host; *p; p++)
+	if (*p == ' ')
+	    *p = '_';
+    for (p = spec; *p; p++)
+	if (*p == ' ')
+	    *p = '_';
+    timer = fsecs_timer(&k);
+    sprintf(key, "%s:%016llx:%s:%d:%s", host, (unsigned long long)h, timer, k, spec);
+    return key;
+}
+
+static int read_calibration(char *path, char *key, double *thruput)
+{
+    FILE *fp;
+    char line[MAXLINE], k[MAXLINE];
+    double x;
+    int found = 0;
+
+    if ((fp = fopen(path, "r")) == NULL)
+	return 0;
+    while (fgets(line, MAXLINE, fp) != NULL)
+	if (sscanf(line, "%1023s %lf", k, &x) == 2 && !strcmp(k, key) && x > 0) {
+	    *thruput = x;
+	    found = 1;
+	}
+    fclose(fp);
+    return found;
+}
+
+static void write_calibration(char *path, char *key, double thruput)
+{
+    FILE *fp;
+
+    if ((fp = fopen(path, "a")) == NULL) {
+	sprintf(msg, "Could not open calibration file %s", path);
+	unix_error(msg);
+    }
+    fprintf(fp, "%s %.0f\n", key, thruput);
+    fclose(fp);
+}
+
+/*
+ * parse_thresholds - parse the regression thresholds (-G), a list of
+ *     util=<points>, thru=<percent> and p99=<percent>
+ */
+static int parse_thresholds(char *spec, double *thresholds)
+{
+    static char *names[3] = {"util", "thru", "p99"};
+    char *s, *tok, *val;
+    int i;
+
+    if ((s = strdup(spec)) == NULL)
+	unix_error("strdup failed in parse_thresholds");
+    for (tok = strtok(s, ","); tok != NULL; tok = strtok(NULL, ",")) {
+	if ((val = strchr(tok, '=')) == NULL)
+	    break;
+	*val++ = '\0';
+	for (i = 0; i < 3 && strcmp(tok, names[i]); i++)
+	    ;
+	if (i == 3 || atof(val) < 0)
+	    break;
+	thresholds[i] = atof(val);
+    }
+    free(s);
+    return (tok == NULL) ? 0 : -1;
+}
+
+/* format_change - format a relative change and its p-value, in percent */
+static void format_change(char *buf, double est, double p)
+{
+    sprintf(buf, "%+7.1f (p=%.3f)", est * 100, p);
+}
+
+/* The change in timing of a trace against its baseline */
+typedef struct {
+    double est, spread, p;     /* throughput: change of the median, range of the baseline, p-value */
+    double pest, pspread, pp;  /* ... and the same for p99 latency */
+    int slow, laggy;           /* do throughput and p99 latency regress? */
+} change_t;
+
+/*
+ * compare_timing - compare the throughput (if thru) and p99 latency
+ *     (if p99) samples of a trace with those of its baseline
+ */
+static void compare_timing(base_trace_t *b, stats_t *st, int thru, int p99,
+			   double *thresholds, change_t *ch)
+{
+    double a[BASE_MAX_SAMPLES], c[BASE_MAX_SAMPLES];
+    int j;
+
+    memset(ch, 0, sizeof(*ch));
+    ch->p = ch->pp = 1;
+    if (thru) {
+	for (j = 0; j < b->num_secs; j++)
+	    a[j] = b->ops / b->secs[j];
+	for (j = 0; j < st->num_samples; j++)
+	    c[j] = st->ops / st->secs_samples[j];
+	compare_samples(a, b->num_secs, c, st->num_samples,
+			&ch->est, &ch->spread, &ch->p);
+	ch->slow = -ch->est * 100 > thresholds[1] && -ch->est > ch->spread &&
+	    ch->p < SIGNIFICANCE;
+    }
+    if (p99) {
+	compare_samples(b->p99, b->num_p99, st->p99_samples, st->num_samples,
+			&ch->pest, &ch->pspread, &ch->pp);
+	ch->laggy = ch->pest * 100 > thresholds[2] && ch->pest > ch->pspread &&
+	    ch->pp < SIGNIFICANCE;
+    }
+}
+
+/*
+ * compare_baseline - compare each trace of the mm package with the
+ *     baseline in a CSV report, and print the changes in util (in
+ *     points), and in the medians of throughput and p99 latency over
+ *     the samples of each side (in percent, with the p-value of the
+ *     Mann-Whitney U test). A trace regresses when util drops by more
+ *     than its threshold, or when throughput or p99 latency get worse
+ *     by more than theirs, by more than the range of the baseline's
+ *     own samples, and the test finds the change significant. The
+ *     samples of a trace are taken one after the other, so a moment
+ *     of noise on the machine can slow them all down: a trace whose
+ *     timing regresses is measured again, and only regresses if it
+ *     does so again. Timing is not compared against a baseline with
+ *     fewer than 2 samples. Returns the number of regressions.
+ */
+static int compare_baseline(char *path, char **tracefiles, int n,
+			    stats_t *stats, double *thresholds)
+{
+    static stats_t again;  /* a trace measured again */
+    base_trace_t *base, *b;
+    stats_t *st;
+    change_t ch;
+    double dutil;
+    char tbuf[64], pbuf[64];
+    int nbase, i, thru, p99, retried, few = 0, regressions = 0;
+
+    base = read_baseline(path, &nbase);
+    printf("Comparison with %s (%% change of the median, Mann-Whitney p):\n", path);
+    printf("%5s%7s%8s%10s%22s%22s\n",
+	   "trace", "util", "d.util", "Kops", "d.thru", "d.p99");
+    for (i = 0; i < n; i++) {
+	b = find_baseline(base, nbase, tracefiles[i]);
+	if (!stats[i].valid || b == NULL || !b->valid || b->num_secs == 0) {
+	    printf("%2d    %s\n", i, !stats[i].valid ? "not valid" :
+		   (b == NULL || !b->valid) ? "no valid baseline" :
+		   "no samples in the baseline");
+	    continue;
+	}
+
+	/* Throughput, and p99 latency if both sides have it */
+	thru = b->num_secs >= 2;
+	few += !thru;
+	p99 = latency && b->num_p99 >= 2;
+	st = &stats[i];
+	compare_timing(b, st, thru, p99, thresholds, &ch);
+	retried = ch.slow || ch.laggy;
+	if (retried) {
+	    memset(&again, 0, sizeof(again));
+	    eval_trace(tracefiles[i], i, 0, NULL, &again);
+	    if (again.valid) {
+		st = &again;
+		compare_timing(b, st, thru, p99, thresholds, &ch);
+	    }
+	}
+	if (thru)
+	    format_change(tbuf, ch.est, ch.p);
+	else
+	    strcpy(tbuf, "-");
+	if (p99)
+	    format_change(pbuf, ch.pest, ch.pp);
+	else
+	    strcpy(pbuf, "-");
+
+	dutil = (stats[i].util - b->util) * 100;
+	if (fabs(dutil) < 1e-6)
+	    dutil = 0;  /* the baseline's util is rounded */
+	printf("%2d%9.0f%%%+8.1f%10.0f%22s%22s%s\n", i, stats[i].util * 100,
+	       dutil, (st->ops / 1e3) / st->secs, tbuf, pbuf,
+	       retried ? "  (measured again)" : "");
+
+	if (-dutil > thresholds[0]) {
+	    printf("REGRESSION [trace %d]: util %+.1f points (threshold %.1f)\n",
+		   i, dutil, thresholds[0]);
+	    regressions++;
+	}
+	if (ch.slow) {
+	    printf("REGRESSION [trace %d]: throughput %+.1f%% (threshold %.1f%%, "
+		   "baseline range %.1f%%, p=%.3f)\n",
+		   i, ch.est * 100, thresholds[1], ch.spread * 100, ch.p);
+	    regressions++;
+	}
+	if (ch.laggy) {
+	    printf("REGRESSION [trace %d]: p99 latency %+.1f%% (threshold %.1f%%, "
+		   "baseline range %.1f%%, p=%.3f)\n",
+		   i, ch.pest * 100, thresholds[2], ch.pspread * 100, ch.pp);
+	    regressions++;
+	}
+    }
+    if (few)
+	printf("Warning: %d trace%s of %s %s fewer than 2 timing samples, so "
+	       "only util was compared (write the baseline with -r)\n", few,
+	       (few == 1) ? "" : "s", path, (few == 1) ? "has" : "have");
+    if (regressions)
+	printf("%d regression%s against the baseline\n\n", regressions,
+	       (regressions == 1) ? "" : "s");
+    else
+	printf("No regressions against the baseline\n\n");
+
+    for (i = 0; i < nbase; i++)
+	free(base[i].file);
+    free(base);
+    return regressions;
+}
+
+#ifdef MM_STATS
+/*
+ * printcounters - prints the allocator's hot-path counters and the
+ *     find_block search-length histograms for each trace (these are
+ *     collected during the util run, so mm.c must be built with
+ *     -DMM_STATS)
+ */
+static void printcounters(int n, stats_t *stats)
+{
+    int i, j;
+    char label[16];
+    struct mm_stats *h;
+
+    printf("\n%5s%9s%9s%9s%9s%9s%9s\n",
+	   "trace", "finds", "misses", "nodes", "nd/find", "splits", "coal");
+    for (i=0; i < n; i++) {
+	h = &stats[i].heap;
+	printf("%2d%12lu%9lu%9lu%9.1f%9lu%9lu\n",
+	       i,
+	       h->find_calls,
+	       h->find_misses,
+	       h->find_nodes,
+	       (h->find_calls == 0) ? 0.0 : 
+	       (double)h->find_nodes / h->find_calls,
+	       h->splits,
+	       h->coalesces);
+    }
+
+    /* Free blocks visited per find_block call, in log2 buckets */
+    printf("\nfind_block nodes visited per call:\n%5s", "trace");
+    for (j=0; j < MM_HIST_BUCKETS; j++) {
+	if (j <= 1)
+	    sprintf(label, "%d", j);
+	else if (j == MM_HIST_BUCKETS - 1)
+	    sprintf(label, "%d+", 1 << (j-1));
+	else
+	    sprintf(label, "%d-%d", 1 << (j-1), (1 << j) - 1);
+	printf("%9s", label);
+    }
+    printf("\n");
+    for (i=0; i < n; i++) {
+	printf("%2d   ", i);
+	for (j=0; j < MM_HIST_BUCKETS; j++)
+	    printf("%9lu", stats[i].heap.find_nodes_hist[j]);
+	printf("\n");
+    }
+
+    /* Segregated lists probed per find_block call */
+    printf("\nfind_block lists probed per call:\n%5s", "trace");
+    for (j=1; j < MM_HIST_BUCKETS; j++)
+	printf("%8d", j);
+    printf("\n");
+    for (i=0; i < n; i++) {
+	printf("%2d   ", i);
+	for (j=1; j < MM_HIST_BUCKETS; j++)
+	    printf("%8lu", stats[i].heap.find_bins_hist[j]);
+	printf("\n");
+    }
 }
+#endif
 
 /* 
  * app_error - Report an arbitrary application error
@@ -993,10 +2977,10 @@ void unix_error(char *msg)
 /*
  * malloc_error - Report an error returned by the mm_malloc package
  */
-void malloc_error(int tracenum, int opnum, char *msg)
+void malloc_error(int tracenum, long long opnum, char *msg)
 {
     errors++;
-    printf("ERROR [trace %d, line %d]: %s\n", tracenum, LINENUM(opnum), msg);
+    printf("ERROR [trace %d, line %lld]: %s\n", tracenum, LINENUM(opnum), msg);
 }
 
 /* 
@@ -1004,14 +2988,32 @@ void malloc_error(int tracenum, int opnum, char *msg)
  */
 static void usage(void) 
 {
-    fprintf(stderr, "Usage: mdriver [-hvVal] [-f <file>] [-t <dir>]\n");
+    fprintf(stderr, "Usage: mdriver [-hvValLmPsSu] [-f <file>] [-t <dir>] [-j <n>]\n"
+		    "               [-T <timer>] [-k <k>] [-r <n>] [-B <file>] [-G <spec>]\n"
+		    "               [-c <file>] [-W <spec>]\n"
+		    "               [--format=json|csv]\n");
     fprintf(stderr, "Options\n");
     fprintf(stderr, "\t-a         Don't check the team structure.\n");
+    fprintf(stderr, "\t-c <file>  Like -m, but keep libc's throughput per host in <file>.\n");
+    fprintf(stderr, "\t-B <file>  Compare with a baseline CSV report; exit 2 on a regression.\n");
     fprintf(stderr, "\t-f <file>  Use <file> as the trace file.\n");
+    fprintf(stderr, "\t-F <fmt>   Write the results to stdout as json or csv (--format).\n");
     fprintf(stderr, "\t-g         Generate summary info for autograder.\n");
+    fprintf(stderr, "\t-G <spec>  Regression thresholds in %%, e.g. util=1,thru=5,p99=10.\n");
     fprintf(stderr, "\t-h         Print this message.\n");
+    fprintf(stderr, "\t-j <n>     Evaluate the traces on <n> worker processes.\n");
+    fprintf(stderr, "\t-k <k>     Keep the K best timing runs (or average <k> runs).\n");
     fprintf(stderr, "\t-l         Run libc malloc as well.\n");
+    fprintf(stderr, "\t-L         Print the latency percentiles of the mm requests.\n");
+    fprintf(stderr, "\t-m         Normalise throughput against libc malloc on this run.\n");
+    fprintf(stderr, "\t-P         Count the hardware events of the mm requests.\n");
+    fprintf(stderr, "\t-r <n>     Take <n> timing samples per trace (default 1, 10 with -B).\n");
+    fprintf(stderr, "\t-s         With -j, time the traces one at a time.\n");
+    fprintf(stderr, "\t-S         Stream the traces (\"-f -\" reads standard input).\n");
     fprintf(stderr, "\t-t <dir>   Directory to find default traces.\n");
+    fprintf(stderr, "\t-T <timer> Time with tsc, clock, itimer or gettod.\n");
+    fprintf(stderr, "\t-u         Don't cap the throughput score at the reference.\n");
+    fprintf(stderr, "\t-W <spec>  Touch payloads when timing: write,read,sweep=<ops>,stride=<n>.\n");
     fprintf(stderr, "\t-v         Print per-trace performance breakdowns.\n");
     fprintf(stderr, "\t-V         Print additional debug info.\n");
 }
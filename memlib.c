@@ -18,6 +18,7 @@
 static char *mem_start_brk;  /* points to first byte of heap */
 static char *mem_brk;        /* points to last byte of heap */
 static char *mem_max_addr;   /* largest legal heap address */ 
+static int mem_sbrk_count;   /* number of mem_sbrk calls since the last reset */
 
 /* 
  * mem_init - initialize the memory system model
@@ -33,6 +34,7 @@ void mem_init(void)
 
     mem_max_addr = mem_start_brk + MAX_HEAP;  /* max legal heap address */
     mem_brk = mem_start_brk;                  /* heap is empty initially */
+    mem_sbrk_count = 0;
 }
 
 /* 
@@ -49,6 +51,7 @@ void mem_deinit(void)
 void mem_reset_brk()
 {
     mem_brk = mem_start_brk;
+    mem_sbrk_count = 0;
 }
 
 /* 
@@ -60,6 +63,8 @@ void *mem_sbrk(int incr)
 {
     char *old_brk = mem_brk;
 
+    mem_sbrk_count++;
+
     // printf("in mem_sbrk, incr: %d, mem_brk: %p, mem_max_addr: %p\n", incr, mem_brk, mem_max_addr);
 
     if ( (incr < 0) || ((mem_brk + incr) > mem_max_addr)) {
@@ -96,6 +101,15 @@ size_t mem_heapsize()
     return (size_t)(mem_brk - mem_start_brk);
 }
 
+/*
+ * mem_sbrk_calls() - returns the number of mem_sbrk calls since the heap
+ *    was last reset
+ */
+int mem_sbrk_calls()
+{
+    return mem_sbrk_count;
+}
+
 /*
  * mem_pagesize() - returns the page size of the system
  */
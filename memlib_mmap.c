@@ -0,0 +1,140 @@
+/*
+ * memlib_mmap.c - a real memory system for the mm package, used when mm.c
+ *     backs real programs (see mm_shim.c). It implements the same interface
+ *     as memlib.c, but the heap is a large mmap reservation whose pages are
+ *     only committed by the kernel when they are touched.
+ *
+ *     This file must not call malloc (or anything that may call malloc),
+ *     because it runs underneath the program's malloc.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <string.h>
+#include <errno.h>
+
+#include "memlib.h"
+
+/* Default size of the address space reserved for the heap */
+#define DEFAULT_RESERVE ((sizeof(void *) == 8) ? ((size_t)16 << 30) : ((size_t)1 << 30))
+
+/* private variables */
+static char *mem_start_brk;  /* points to first byte of heap */
+static char *mem_brk;        /* points to last byte of heap */
+static char *mem_max_addr;   /* largest legal heap address */
+static int mem_sbrk_count;   /* number of mem_sbrk calls since the last reset */
+
+/*
+ * mem_error - write a message to stderr without going through stdio
+ *    (stdio may allocate)
+ */
+static void mem_error(const char *msg)
+{
+    ssize_t ignored = write(STDERR_FILENO, msg, strlen(msg));
+    (void)ignored;
+}
+
+/*
+ * mem_init - reserve the address space for the heap. The size of the
+ *    reservation (in MB) can be overridden with the MM_HEAP_RESERVE_MB
+ *    environment variable.
+ */
+void mem_init(void)
+{
+    size_t reserve = DEFAULT_RESERVE;
+    char *env = getenv("MM_HEAP_RESERVE_MB");
+
+    if (env != NULL && atol(env) > 0)
+	reserve = (size_t)atol(env) << 20;
+
+    mem_start_brk = mmap(NULL, reserve, PROT_READ | PROT_WRITE,
+			 MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (mem_start_brk == MAP_FAILED) {
+	mem_error("mem_init: mmap error\n");
+	exit(1);
+    }
+
+    mem_max_addr = mem_start_brk + reserve;  /* max legal heap address */
+    mem_brk = mem_start_brk;                 /* heap is empty initially */
+    mem_sbrk_count = 0;
+}
+
+/*
+ * mem_deinit - give the reservation back to the kernel
+ */
+void mem_deinit(void)
+{
+    munmap(mem_start_brk, mem_max_addr - mem_start_brk);
+}
+
+/*
+ * mem_reset_brk - reset the brk pointer to make an empty heap, and let
+ *    the kernel reclaim the pages that were in use
+ */
+void mem_reset_brk()
+{
+    madvise(mem_start_brk, mem_brk - mem_start_brk, MADV_DONTNEED);
+    mem_brk = mem_start_brk;
+    mem_sbrk_count = 0;
+}
+
+/*
+ * mem_sbrk - extends the heap by incr bytes and returns the start address
+ *    of the new area. The heap cannot be shrunk.
+ */
+void *mem_sbrk(int incr)
+{
+    char *old_brk = mem_brk;
+
+    mem_sbrk_count++;
+
+    if ((incr < 0) || (incr > mem_max_addr - mem_brk)) {
+	errno = ENOMEM;
+	mem_error("ERROR: mem_sbrk failed. Ran out of reserved heap...\n");
+	return (void *)-1;
+    }
+    mem_brk += incr;
+    return (void *)old_brk;
+}
+
+/*
+ * mem_heap_lo - return address of the first heap byte
+ */
+void *mem_heap_lo()
+{
+    return (void *)mem_start_brk;
+}
+
+/*
+ * mem_heap_hi - return address of last heap byte
+ */
+void *mem_heap_hi()
+{
+    return (void *)(mem_brk - 1);
+}
+
+/*
+ * mem_heapsize() - returns the heap size in bytes
+ */
+size_t mem_heapsize()
+{
+    return (size_t)(mem_brk - mem_start_brk);
+}
+
+/*
+ * mem_sbrk_calls() - returns the number of mem_sbrk calls since the heap
+ *    was last reset
+ */
+int mem_sbrk_calls()
+{
+    return mem_sbrk_count;
+}
+
+/*
+ * mem_pagesize() - returns the page size of the system
+ */
+size_t mem_pagesize()
+{
+    return (size_t)getpagesize();
+}
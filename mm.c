@@ -5,6 +5,9 @@
 #include <string.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <limits.h>
+#include <math.h>
+#include <execinfo.h>
 
 #include "mm.h"
 #include "memlib.h"
@@ -35,8 +38,19 @@ typedef struct Header
         int alloc_bit: 1;   /* 0: free, 1: allocated */
         size_t block_size;
     };
-    struct Header *prev;    /* previous free memory block in the free memory block list */
-    struct Header *next;    /* next free memory block in the free memory block list */
+    union {
+        struct {                            /* used while the block is FREE */
+            struct Header *prev;            /* previous free memory block in the free memory block list */
+            struct Header *next;            /* next free memory block in the free memory block list */
+        };
+        struct {                            /* used while the block is ALLOCATED */
+#if LIFETIME_SEGREGATION
+            uint32_t birth;                 /* value of op_clock when the block was allocated */
+            uint16_t region;                /* LONG_REGION, SHORT_REGION or FENCE_REGION */
+#endif
+            uint16_t flags;                 /* SAMPLED_FLAG if the heap profiler keeps track of the block */
+        };
+    };
 } Header;
 
 typedef struct Footer
@@ -47,19 +61,53 @@ typedef struct Footer
 /*********************************************************
  * Basic constants and macros
  ********************************************************/
-#define ALIGNMENT                                       8           /* double word (8 bytes) alignment */
-#define ALIGNMENT_MASK                                  0x0007
+#define ALIGNMENT                                       (2 * sizeof(size_t))    /* double word alignment (8 bytes with -m32, 16 bytes on 64-bit hosts) */
+#define ALIGNMENT_MASK                                  (ALIGNMENT - 1)
 
-/* Make sure the size of Header is round up to the nearest multiple of 8 */
+/* Make sure the size of Header is round up to the nearest multiple of ALIGNMENT */
 static const uint16_t HEADER_SIZE = ((sizeof(Header) + (ALIGNMENT - 1)) & ~ALIGNMENT_MASK);
 static const uint16_t FOOTER_SIZE = ((sizeof(Footer) + (ALIGNMENT - 1)) & ~ALIGNMENT_MASK);
 
-#define POINTER_SIZE_TYPE                               uint32_t
+#define POINTER_SIZE_TYPE                               uintptr_t
 #define CHUNKSIZE   			                        (1 << 12)   /* Extend heap by this amount (4096 bytes) */
 #define WSIZE       			                        4           /* word size (byte) */
 #define DSIZE       			                        8           /* double word size (byte) */
 #define MIN_BLOCK_SIZE                                  ((size_t) (HEADER_SIZE + FOOTER_SIZE + 8))
 
+/* heap growth controller: the extension size adapts to how often the heap has to grow */
+#define GROWTH_MIN_CHUNK                                (1 << 6)    /* smallest extension (64 bytes) */
+#define GROWTH_MAX_CHUNK                                (1 << 14)   /* largest extension (16 KB) */
+#define GROWTH_HEAP_SHIFT                               4           /* an extension never exceeds (heap size >> GROWTH_HEAP_SHIFT) */
+#define GROWTH_FAST_WINDOW                              16          /* extensions closer than this many mallocs double the chunk */
+#define GROWTH_SLOW_WINDOW                              256         /* extensions further apart than this many mallocs halve the chunk */
+
+/* split placement: build with -DSIZE_DIRECTED_SPLIT=1 to carve small requests from the high end and large requests from the low end of a free block
+ * (default traces: binary-bal util 49% -> 77%, binary2-bal 36% -> 54%, realloc2-bal 50% -> 36%, perf index 84 -> 86, at the cost of half the binary traces' throughput) */
+#ifndef SIZE_DIRECTED_SPLIT
+#define SIZE_DIRECTED_SPLIT                             0
+#endif
+#define SPLIT_SMALL_THRESHOLD                           128         /* adjusted sizes below this value are small requests */
+
+/* lifetime-aware regions: build with -DLIFETIME_SEGREGATION=1 to place predicted short-lived blocks in separate fenced arenas
+ * (default traces: perf index 84 -> 81, coalescing-bal util 99% -> 65%, realloc2-bal 50% -> 27%, only cccp-bal gains, 91% -> 93%) */
+#ifndef LIFETIME_SEGREGATION
+#define LIFETIME_SEGREGATION                            0
+#endif
+#define SHORT_LIFETIME_OPS                              16          /* size classes whose average lifetime (in mm_malloc/mm_free calls) is below this are short-lived */
+#define LIFETIME_MIN_SAMPLES                            16          /* a size class needs this many frees before it can be predicted short-lived */
+#define LIFETIME_EWMA_SHIFT                             3           /* weight of a new lifetime sample is 1/(1 << LIFETIME_EWMA_SHIFT) */
+#define SHORT_ARENA_SIZE                                (1 << 12)   /* size of a short-lived arena, including its two fences (4096 bytes) */
+#define FENCE_SIZE                                      ((size_t) (HEADER_SIZE + FOOTER_SIZE))
+
+/* the region a block belongs to (stored in the Header of allocated blocks) */
+#define LONG_REGION                                     0
+#define SHORT_REGION                                    1
+#define FENCE_REGION                                    2           /* the allocated blocks bracketing a short-lived arena */
+#define REGION_NUM                                      (LIFETIME_SEGREGATION ? 2 : 1)  /* the number of regions with their own segregated free lists */
+
+/* flags of allocated blocks */
+#define SAMPLED_FLAG                                    0x1         /* the block is in the heap profiler's side table */
+
 /* given a pointer to a Header, get its allocate bit or size in uint32_t */
 #define GET_ALLOC_BIT(ptr)                              (*((uint32_t *) ptr) & 0x1)
 #define GET_SIZE(ptr)                                   (*((uint32_t *) ptr) & 0xfffffff8)
@@ -95,41 +143,113 @@ static const uint16_t FOOTER_SIZE = ((sizeof(Footer) + (ALIGNMENT - 1)) & ~ALIGN
 #define GET_NEXT_LINK_OF_PRV_BLOCK(ptr)                 ((Header *) (GET_PRV_BLOCK_ADDR(ptr)))->next
 #define GET_PREV_LINK_OF_PRV_BLOCK(ptr)                 ((Header *) (GET_PRV_BLOCK_ADDR(ptr)))->prev
 
+/* given a pointer to a Header, check whether the block is the last block of the heap */
+#define IS_LAST_BLOCK(ptr)                              ((((size_t) ptr) + GET_SIZE(ptr)) == (((size_t) mem_heap_hi()) + 1))
+
+/* count an allocator event, compiled out unless built with -DMM_STATS */
+#ifdef MM_STATS
+#define STATS_ADD(counter, n)                           (arena_counters.counter += (n))
+#define STATS_HIST(hist, bucket)                        (arena_counters.hist[MIN((bucket), MM_HIST_BUCKETS - 1)]++)
+#else
+#define STATS_ADD(counter, n)                           ((void) 0)
+#define STATS_HIST(hist, bucket)                        ((void) 0)
+#endif
+
 /* given two numbers, x and y, return the bigger one */
 #define MAX(x, y)                   \
     ({ typeof (x) _x = (x);         \
        typeof (y) _y = (y);         \
        (_x > _y) ? (_x) : (_y); })
 
+/* given two numbers, x and y, return the smaller one */
+#define MIN(x, y)                   \
+    ({ typeof (x) _x = (x);         \
+       typeof (y) _y = (y);         \
+       (_x < _y) ? (_x) : (_y); })
+
 /*********************************************************
  * Global variables
  ********************************************************/
 static uint8_t *heap_listp = 0;             /* pointer to first block */
+static Header *wilderness = NULL;           /* the free block at the end of the heap (not in any free list), or NULL if the last block is allocated */
+static size_t growth_chunk = 0;             /* the current extension size of the growth controller */
+static size_t malloc_count = 0;             /* number of mm_malloc calls since mm_init */
+static size_t last_extend_count = 0;        /* value of malloc_count at the last heap extension */
+#if LIFETIME_SEGREGATION
+static uint32_t op_clock = 0;               /* number of mm_malloc and mm_free calls since mm_init, used to measure lifetimes */
+static Header *spare_arena = NULL;          /* the interior of an empty short-lived arena kept for reuse, or NULL */
+#endif
+#ifdef MM_STATS
+static struct mm_stats arena_counters;      /* event counters of the heap, merged into the gauges in mm_get_stats */
+#endif
 
 /*********************************************************
  * Function prototypes for internal helper routines
  ********************************************************/
 static void *coalesce(Header *ptr);
 static void *extend_heap(size_t words);
-static void split_block(Header *block_ptr, const size_t *adjusted_size);
-static Header *find_block(const size_t *size);
+static size_t growth_size(size_t shortfall);
+static void remove_free_block(Header *ptr);
+static void insert_free_block(Header *ptr, int region);
+static Header *split_block(Header *block_ptr, const size_t *adjusted_size, int region);
+static Header *find_block(const size_t *size, int region);
+static Header *allocate_block(size_t adjusted_size, int region);
 static size_t adjust_size(size_t size);
+static void *malloc_payload(size_t size);
+static uint8_t *align_payload(uint8_t *bp, size_t alignment);
 void print_free_list();
 void print_heap();
 
 /*********************************************************
  * Macros, global variables, and function prototypes necessary for segregated free list
  ********************************************************/
-#define LIST_NUM    7                       /* the number of lists for segregated free lists */
-static Header segregated_list[LIST_NUM];    /* the segregated free list */
-static Header epilogue_list[LIST_NUM];
+#define LIST_NUM    7                       /* the number of lists for segregated free lists (per region) */
+static Header segregated_list[REGION_NUM * LIST_NUM];   /* the segregated free list, LIST_NUM lists for each region */
+static Header epilogue_list[REGION_NUM * LIST_NUM];
 static size_t max_threshold = 0;            /* block size greater than this value will be put into segregated_list[LIST_NUM - 1]. Value will be calculated in mm_init */
 static size_t min_threshold = 0;            /* block size less than and equal to this value will be put into segregated_list[0]. Value will be calculated in mm_init */
 static int lowest_exponent = 0;             /* value will be calculated in mm_init */
 static int nearest_exponent(size_t block_size);
 static int get_list_idx(size_t block_size);
 static int get_list_idx_for_find_block(size_t block_size);
-static void insert_segregated_list(Header *ptr);
+static void insert_segregated_list(Header *ptr, int region);
+
+/*********************************************************
+ * Macros, global variables, and function prototypes necessary for lifetime-aware regions
+ ********************************************************/
+#if LIFETIME_SEGREGATION
+static int32_t lifetime_avg[LIST_NUM];      /* average lifetime (in op_clock ticks) of the blocks in each size class */
+static uint32_t lifetime_samples[LIST_NUM]; /* number of lifetimes observed for each size class */
+static void record_lifetime(Header *ptr);
+static Header *create_short_arena(size_t adjusted_size);
+static int is_fence(Header *ptr);
+static void release_short_arena(Header *interior);
+#endif
+static int predict_region(size_t adjusted_size);
+
+/*********************************************************
+ * Macros, global variables, and function prototypes necessary for the sampling heap profiler
+ ********************************************************/
+#define PROFILE_TABLE_SIZE      1024                /* capacity of the side table of sampled live objects (a power of 2) */
+#define PROFILE_MAX_DEPTH       16                  /* return addresses kept for each sampled object */
+
+typedef struct Sample
+{
+    void *ptr;                                      /* payload address of the sampled object, NULL if the slot is empty */
+    size_t size;                                    /* requested size of the object */
+    int depth;                                      /* number of return addresses in stack */
+    void *stack[PROFILE_MAX_DEPTH];                 /* the call chain that allocated the object */
+} Sample;
+
+static long sample_countdown = LONG_MAX;            /* bytes left until the next sampled allocation */
+static size_t sample_interval = 0;                  /* mean sampling interval in bytes, 0 if the profiler is off */
+static uint32_t sample_rng = 0x9e3779b9;            /* state of the xorshift generator for the intervals */
+static Sample sample_table[PROFILE_TABLE_SIZE];     /* sampled live objects, open addressing keyed by pointer */
+static int sample_count = 0;                        /* number of objects in sample_table */
+static void profile_sample(void *bp, size_t size);
+static void profile_forget(void *bp);
+static long next_sample_interval(void);
+static int sample_slot(void *bp);
 
 /*********************************************************
  * Internal helper routines
@@ -188,15 +308,16 @@ static int nearest_exponent(size_t block_size)
 /* 
  * insert_segregated_list -
  *      insert a new free block to segregated free list
- *      index of segregated free list will be calculated according to its block_size
+ *      index of segregated free list will be calculated according to its block_size and region
  *      Insertion policy: Last-In-First-Out (will be inserted into the beginning of the list)
  * 
  * @ptr: a pointer to the new free memory block
+ * @region: the region the block belongs to (LONG_REGION or SHORT_REGION)
  */
-static void insert_segregated_list(Header *ptr)
+static void insert_segregated_list(Header *ptr, int region)
 {
     size_t size = GET_SIZE(ptr);
-    int idx = get_list_idx(size);
+    int idx = region * LIST_NUM + get_list_idx(size);
     Header *prologue = (segregated_list + idx);
 
     ptr->prev = prologue;
@@ -205,6 +326,141 @@ static void insert_segregated_list(Header *ptr)
     prologue->next = ptr;
 }
 
+/*
+ * remove_free_block - unlink a free block from the segregated free list it belongs to
+ *      the wilderness is not in any list, so removing it only forgets the wilderness
+ *      (the caller is responsible for handing the merged block back through insert_free_block)
+ *
+ * @ptr: a pointer to the Header of a free memory block
+ */
+static void remove_free_block(Header *ptr)
+{
+    if (ptr == wilderness) {
+        wilderness = NULL;
+        return;
+    }
+
+    ptr->prev->next = ptr->next;
+    ptr->next->prev = ptr->prev;
+}
+
+/*
+ * insert_free_block - give a free block back to the allocator
+ *      the block at the end of the heap becomes the wilderness, every other block goes to the segregated free list
+ *      (blocks of a short-lived arena are never the last block, because the arena ends with a fence)
+ *
+ * @ptr: a pointer to the Header of a free memory block
+ * @region: the region the block belongs to (LONG_REGION or SHORT_REGION)
+ */
+static void insert_free_block(Header *ptr, int region)
+{
+    if (IS_LAST_BLOCK(ptr)) {
+        wilderness = ptr;
+    }
+    else {
+        insert_segregated_list(ptr, region);
+    }
+}
+
+/*
+ * predict_region - predict in which region a new block should be placed
+ *
+ * @adjusted_size: the adjusted size of the requested block
+ * @return: SHORT_REGION if blocks of this size class have been short-lived recently, LONG_REGION otherwise
+ */
+static int predict_region(size_t adjusted_size)
+{
+#if LIFETIME_SEGREGATION
+    int idx = get_list_idx(adjusted_size);
+
+    if (lifetime_samples[idx] >= LIFETIME_MIN_SAMPLES && lifetime_avg[idx] < SHORT_LIFETIME_OPS) {
+        return SHORT_REGION;
+    }
+#endif
+    return LONG_REGION;
+}
+
+#if LIFETIME_SEGREGATION
+/*
+ * record_lifetime - feed the lifetime of a block that is being freed to the predictor of its size class
+ *      the predictor keeps an exponentially weighted moving average of the lifetimes, in op_clock ticks
+ *
+ * @ptr: a pointer to the Header of the ALLOCATED block being freed
+ */
+static void record_lifetime(Header *ptr)
+{
+    int idx = get_list_idx(GET_SIZE(ptr));
+    int32_t lifetime = (int32_t) (op_clock - ptr->birth);
+
+    lifetime_avg[idx] += (lifetime - lifetime_avg[idx]) >> LIFETIME_EWMA_SHIFT;
+    lifetime_samples[idx]++;
+}
+
+/*
+ * is_fence - check whether a block is one of the fences bracketing a short-lived arena
+ */
+static int is_fence(Header *ptr)
+{
+    return (GET_ALLOC_BIT(ptr) == ALLOCATED) && (ptr->region == FENCE_REGION);
+}
+
+/*
+ * create_short_arena - carve a new short-lived arena out of the long-lived region
+ *      the arena is laid out as [fence][interior][fence], the fences are allocated blocks that are never freed,
+ *      so blocks in the interior never coalesce with blocks outside of the arena
+ *      the interior is inserted into the SHORT_REGION segregated free list
+ *
+ * @adjusted_size: the adjusted size of the request that has to fit in the interior
+ * @return: the Header of the interior (a free block), or NULL if the heap can't be extended
+ */
+static Header *create_short_arena(size_t adjusted_size)
+{
+    size_t arena_size = MAX((size_t) SHORT_ARENA_SIZE, adjusted_size + 2 * FENCE_SIZE);
+    Header *front_fence = allocate_block(arena_size, LONG_REGION);
+
+    if (front_fence == NULL) {
+        return NULL;
+    }
+
+    /* the long-lived region may have handed out a slightly bigger block than requested */
+    arena_size = GET_SIZE(front_fence);
+    size_t interior_size = arena_size - 2 * FENCE_SIZE;
+    Header *interior = (void *) (((uint8_t *) front_fence) + FENCE_SIZE);
+    Header *back_fence = (void *) (((uint8_t *) interior) + interior_size);
+
+    SET_SIZE_AND_ALLOC_BIT(front_fence, FENCE_SIZE, ALLOCATED);
+    SET_FOOTER(front_fence, FENCE_SIZE);
+    front_fence->region = FENCE_REGION;
+
+    SET_SIZE_AND_ALLOC_BIT(back_fence, FENCE_SIZE, ALLOCATED);
+    SET_FOOTER(back_fence, FENCE_SIZE);
+    back_fence->region = FENCE_REGION;
+
+    SET_SIZE_AND_ALLOC_BIT(interior, interior_size, FREE);
+    SET_FOOTER(interior, interior_size);
+    insert_segregated_list(interior, SHORT_REGION);
+
+    return interior;
+}
+
+/*
+ * release_short_arena - give an empty short-lived arena back to the long-lived region as a whole
+ *      the fences are dissolved and the arena is coalesced with its neighbours
+ *
+ * @interior: the Header of the free block spanning the whole interior (not in any free list)
+ */
+static void release_short_arena(Header *interior)
+{
+    Header *front_fence = (Header *) GET_PRV_BLOCK_ADDR(interior);
+    size_t size = FENCE_SIZE + GET_SIZE(interior) + FENCE_SIZE;
+
+    SET_SIZE_AND_ALLOC_BIT(front_fence, size, FREE);
+    SET_FOOTER(front_fence, size);
+
+    insert_free_block(coalesce(front_fence), LONG_REGION);
+}
+#endif
+
 /*
  * coalesce
  *      given a pointer to a Header of a free memory block, check its previous and next adjacent blocks are free or not
@@ -220,16 +476,18 @@ static void *coalesce(Header *ptr)
     /* get the alloc_bit of contiguous prev and next blocks 
      * but should first check is this block the first block? is this block the last block? */
     uint32_t prev_alloc = ((void *) ptr == (void *) heap_listp) ? 1 : GET_PRV_BLOCK_ALLOC_BIT(ptr);
-    uint32_t next_alloc = (((size_t) ptr) + GET_SIZE(ptr) == ((size_t) mem_heap_hi()) + 1) ? 1 : GET_NXT_BLOCK_ALLOC_BIT(ptr);
+    uint32_t next_alloc = IS_LAST_BLOCK(ptr) ? 1 : GET_NXT_BLOCK_ALLOC_BIT(ptr);
+
+    STATS_ADD(coalesces, (prev_alloc == FREE) + (next_alloc == FREE));
 
     /* if both prev and next contiguous blocks are ALLOCATED */
     if (prev_alloc == ALLOCATED && next_alloc == ALLOCATED) {
         return ptr;
     }
+
     /* if prev block is ALLOCATED but next block is FREE */
     else if (prev_alloc == ALLOCATED && next_alloc == FREE) {
-        ((Header *) (GET_NXT_BLOCK_ADDR(ptr)))->prev->next = GET_NEXT_LINK_OF_NXT_BLOCK(ptr);
-        ((Header *) (GET_NXT_BLOCK_ADDR(ptr)))->next->prev = GET_PREV_LINK_OF_NXT_BLOCK(ptr);
+        remove_free_block((Header *) GET_NXT_BLOCK_ADDR(ptr));
 
         size += GET_NXT_BLOCK_SIZE(ptr);
         SET_SIZE_AND_ALLOC_BIT(ptr, size, FREE);
@@ -237,8 +495,7 @@ static void *coalesce(Header *ptr)
     }
     /* if prev block is FREE but next block is ALLOCATED */
     else if (prev_alloc == FREE && next_alloc == ALLOCATED) {
-        ((Header *) (GET_PRV_BLOCK_ADDR(ptr)))->prev->next = GET_NEXT_LINK_OF_PRV_BLOCK(ptr);
-        ((Header *) (GET_PRV_BLOCK_ADDR(ptr)))->next->prev = GET_PREV_LINK_OF_PRV_BLOCK(ptr);
+        remove_free_block((Header *) GET_PRV_BLOCK_ADDR(ptr));
         
         size += GET_PRV_BLOCK_SIZE(ptr);
         ptr = (void *) GET_PRV_BLOCK_ADDR(ptr);
@@ -247,10 +504,8 @@ static void *coalesce(Header *ptr)
     }
     /* if both prev and next contiguous blocks are FREE */
     else {
-        ((Header *) (GET_NXT_BLOCK_ADDR(ptr)))->prev->next = GET_NEXT_LINK_OF_NXT_BLOCK(ptr);
-        ((Header *) (GET_NXT_BLOCK_ADDR(ptr)))->next->prev = GET_PREV_LINK_OF_NXT_BLOCK(ptr);
-        ((Header *) (GET_PRV_BLOCK_ADDR(ptr)))->prev->next = GET_NEXT_LINK_OF_PRV_BLOCK(ptr);
-        ((Header *) (GET_PRV_BLOCK_ADDR(ptr)))->next->prev = GET_PREV_LINK_OF_PRV_BLOCK(ptr);
+        remove_free_block((Header *) GET_NXT_BLOCK_ADDR(ptr));
+        remove_free_block((Header *) GET_PRV_BLOCK_ADDR(ptr));
 
         size += (GET_PRV_BLOCK_SIZE(ptr) + GET_NXT_BLOCK_SIZE(ptr));
         ptr = (void *) GET_PRV_BLOCK_ADDR(ptr);
@@ -262,10 +517,10 @@ static void *coalesce(Header *ptr)
 }
 
 /* 
- * extend_heap - Extend heap with free block and return its block pointer
- *      the new block will coalesce with contiguous free block
- *      the new block won't go to free memory list
- *      the alloc_bit of the new block will set to FREE in this function and will later set to ALLOCATED in mm_malloc
+ * extend_heap - Extend heap with free block and return the new wilderness
+ *      the new chunk is always coalesced with the wilderness (if there is one), so the wilderness only grows by the new chunk
+ *      the new wilderness won't go to free memory list
+ *      the alloc_bit of the wilderness stays FREE in this function and will later set to ALLOCATED in mm_malloc
  */
 static void *extend_heap(size_t words) 
 {
@@ -278,15 +533,52 @@ static void *extend_heap(size_t words)
         return NULL;
     }
 
+    /* coalesce the newly assigned chunk with the wilderness
+     * (done here rather than in coalesce, because the chunk may be smaller than MIN_BLOCK_SIZE) */
+    if (wilderness != NULL) {
+        size += GET_SIZE(wilderness);
+        SET_SIZE_AND_ALLOC_BIT(wilderness, size, FREE);
+        SET_FOOTER(wilderness, size);
+        return wilderness;
+    }
+
     /* create the Header and Footer of the newly assigned chunk */
     Header *new_chunk = (void *) ptr;
     SET_SIZE_AND_ALLOC_BIT(new_chunk, size, FREE);
     SET_FOOTER(new_chunk, size);
 
-    // new_chunk = coalesce(new_chunk);
+    wilderness = new_chunk;
     return new_chunk;
 }
 
+/*
+ * growth_size - decide how many bytes to extend the heap by
+ *      the growth chunk doubles when the heap has to grow again shortly after the last extension,
+ *      and halves when extensions are rare, so growth-heavy traces call mem_sbrk less often
+ *      while a single large request is not over-extended
+ *      the chunk is capped by GROWTH_MAX_CHUNK and by a fraction of the current heap size
+ *
+ * @shortfall: the number of bytes the wilderness is missing for the current request
+ * @return: the extension size in bytes (a multiple of DSIZE, and at least shortfall)
+ */
+static size_t growth_size(size_t shortfall)
+{
+    size_t since_last_extend = malloc_count - last_extend_count;
+    last_extend_count = malloc_count;
+
+    if (since_last_extend <= GROWTH_FAST_WINDOW) {
+        growth_chunk <<= 1;
+    }
+    else if (since_last_extend > GROWTH_SLOW_WINDOW) {
+        growth_chunk >>= 1;
+    }
+
+    growth_chunk = MIN(growth_chunk, MIN((size_t) GROWTH_MAX_CHUNK, mem_heapsize() >> GROWTH_HEAP_SHIFT));
+    growth_chunk = MAX(growth_chunk, (size_t) GROWTH_MIN_CHUNK) & ~((size_t) ALIGNMENT_MASK);
+
+    return MAX(shortfall, growth_chunk);
+}
+
 /*
  * print_free_list - iterate through the list and print out the info of each free block
  */
@@ -294,8 +586,12 @@ void print_free_list()
 {
     printf("info of segregated list:\n");
 
-    for (int i = 0; i < LIST_NUM; ++i) {
-        printf("seg list [%d]: ", i);
+    if (wilderness != NULL) {
+        printf("wilderness: [size: %u, start addr: %zu, end addr: %zu]\n", GET_SIZE(wilderness), (size_t) wilderness, ((size_t) wilderness) + GET_SIZE(wilderness));
+    }
+
+    for (int i = 0; i < REGION_NUM * LIST_NUM; ++i) {
+        printf("%s seg list [%d]: ", (i < LIST_NUM) ? "long" : "short", i % LIST_NUM);
         Header *ptr = (segregated_list + i), *epilogue = (epilogue_list + i);
         int idx = 0;
         while (ptr != epilogue) {
@@ -342,14 +638,39 @@ void print_heap()
  *          - new_block:
  *              - block_size = (original block_size - adjusted_size)
  *              - alloc_bit = FREE
- *              - will be insert into free memory list in this function
+ *              - will be insert into free memory list in this function (or become the wilderness if it's the last block)
  *              - coalesce won't be performed for new_block, cuz if it can coalesce, it should already be coalesced earlier in mm_malloc
  *          - original block:
  *              - block_size = adjusted_size
  *              - alloc_bit = original alloc_bit
+ *      Placement policy (SIZE_DIRECTED_SPLIT):
+ *          small requests are carved from the high end of the block and large requests from the low end,
+ *          so like-sized blocks cluster together and freed large blocks coalesce into big runs
+ *          this includes the wilderness: a small block carved from its high end becomes the last block,
+ *          and the rest of the wilderness goes to the free list (freeing the small block makes it the wilderness again)
+ * 
+ * @region: the region of the block, the remaining free block stays in the same region
+ * @return: the address of the Header of the block holding adjusted_size bytes
  */
-static void split_block(Header *block_ptr, const size_t *adjusted_size)
+static Header *split_block(Header *block_ptr, const size_t *adjusted_size, int region)
 {
+    STATS_ADD(splits, 1);
+
+#if SIZE_DIRECTED_SPLIT
+    if (*adjusted_size < SPLIT_SMALL_THRESHOLD) {
+        Header *alloc_block = (void *) (((uint8_t *) block_ptr) + GET_SIZE(block_ptr) - *adjusted_size);
+        size_t remain_size = (GET_SIZE(block_ptr) - *adjusted_size);
+        SET_SIZE_AND_ALLOC_BIT(alloc_block, *adjusted_size, GET_ALLOC_BIT(block_ptr));
+        SET_FOOTER(alloc_block, *adjusted_size);
+
+        SET_SIZE_AND_ALLOC_BIT(block_ptr, remain_size, FREE);
+        SET_FOOTER(block_ptr, remain_size);
+
+        insert_free_block(block_ptr, region);
+        return alloc_block;
+    }
+#endif
+
     Header *new_block = (void *) (((uint8_t *) block_ptr) + *adjusted_size);
     size_t new_block_size = (GET_SIZE(block_ptr) - *adjusted_size);
     SET_SIZE_AND_ALLOC_BIT(new_block, new_block_size, FREE);
@@ -358,7 +679,8 @@ static void split_block(Header *block_ptr, const size_t *adjusted_size)
     SET_SIZE_AND_ALLOC_BIT(block_ptr, *adjusted_size, GET_ALLOC_BIT(block_ptr));
     SET_FOOTER(block_ptr, *adjusted_size);
 
-    insert_segregated_list(new_block);
+    insert_free_block(new_block, region);
+    return block_ptr;
 }
 
 /* 
@@ -369,17 +691,37 @@ static void split_block(Header *block_ptr, const size_t *adjusted_size)
  *      Placement policy: first fit
  * 
  * @size: the memory block size (in byte) requested
+ * @region: only the segregated free list of this region is searched
  * @return: the address of the found free block, or NULL if not found
  */
-static Header *find_block(const size_t *size)
+static Header *find_block(const size_t *size, int region)
 {
-    int idx = get_list_idx_for_find_block(*size);
-    Header *iterator = (segregated_list + idx), *epilogue = (epilogue_list + LIST_NUM - 1);
+    int idx = region * LIST_NUM + get_list_idx_for_find_block(*size);
+    Header *iterator = (segregated_list + idx), *epilogue = (epilogue_list + region * LIST_NUM + LIST_NUM - 1);
+
+#ifdef MM_STATS
+    int nodes = 0, bins = 1;
+#endif
 
     while ((iterator != epilogue) && (GET_SIZE(iterator) < *size)) {
             iterator = iterator->next;
+#ifdef MM_STATS
+            /* the lists are chained through their sentinels, so entering a new prologue means probing the next list */
+            if (GET_SIZE(iterator) != 0) {
+                nodes++;
+            }
+            else if (iterator->prev == NULL) {
+                bins++;
+            }
+#endif
     }
 
+    STATS_ADD(find_calls, 1);
+    STATS_ADD(find_nodes, nodes);
+    STATS_ADD(find_misses, iterator == epilogue);
+    STATS_HIST(find_nodes_hist, (nodes == 0) ? 0 : nearest_exponent(nodes + 1));
+    STATS_HIST(find_bins_hist, bins);
+
     return (iterator == epilogue) ? NULL : iterator;
 }
 
@@ -404,6 +746,68 @@ static size_t adjust_size(size_t size)
     return size;
 }
 
+/*
+ * allocate_block - find (or make) a free block of at least adjusted_size bytes in a region and allocate it
+ *      LONG_REGION: search the long-lived segregated free list, then use the wilderness (extend the heap if needed)
+ *      SHORT_REGION: search the short-lived segregated free list, then carve a new short-lived arena
+ *
+ * @adjusted_size: the adjusted size of the requested block
+ * @region: the region to allocate from
+ * @return: the address of the Header of the allocated block, or NULL if the heap can't be extended
+ */
+static Header *allocate_block(size_t adjusted_size, int region)
+{
+    Header *block_ptr = find_block(&adjusted_size, region);
+
+#if LIFETIME_SEGREGATION
+    /* can't find big enough free memory block in the short-lived lists, make a new arena */
+    if (block_ptr == NULL && region == SHORT_REGION) {
+        if ((block_ptr = create_short_arena(adjusted_size)) == NULL) {
+            return NULL;
+        }
+    }
+#endif
+
+    /* can't find big enough free memory block in the lists, use the wilderness */
+    if (block_ptr == NULL) {
+        size_t wilderness_size = (wilderness == NULL) ? 0 : GET_SIZE(wilderness);
+
+        /* the wilderness is too small, extend the heap by the shortfall (or the growth chunk if it's larger) */
+        if (wilderness_size < adjusted_size) {
+            if (extend_heap(growth_size(adjusted_size - wilderness_size)/WSIZE) == NULL) {
+                return NULL;
+            }
+        }
+
+        block_ptr = wilderness;
+    }
+
+#if LIFETIME_SEGREGATION
+    /* the spare arena is being reused */
+    if (block_ptr == spare_arena) {
+        spare_arena = NULL;
+    }
+#endif
+
+    /* remove the block from the free list (or take over the wilderness) */
+    remove_free_block(block_ptr);
+    
+    /* set the alloc_bit of the block as allocated */
+    SET_SIZE_AND_ALLOC_BIT(block_ptr, GET_SIZE(block_ptr), ALLOCATED);
+
+    /* if the remaining space is >= MIN_BLOCK_SIZE, split the memroy block */
+    if ((GET_SIZE(block_ptr) - adjusted_size) >= MIN_BLOCK_SIZE) {
+        block_ptr = split_block(block_ptr, &adjusted_size, region);
+    }
+
+#if LIFETIME_SEGREGATION
+    block_ptr->birth = op_clock;
+    block_ptr->region = region;
+#endif
+    block_ptr->flags = 0;
+    return block_ptr;
+}
+
 /*********************************************************
  * Major functions
  ********************************************************/
@@ -429,7 +833,7 @@ int mm_init(void)
     heap_listp = (uint8_t *)(( (POINTER_SIZE_TYPE) &heap_listp[ALIGNMENT] ) & ( ~((POINTER_SIZE_TYPE) ALIGNMENT_MASK)));
 
     /* initialization of segregated_list and epilogue_list */
-    for (int i = 0; i < LIST_NUM; ++i) {
+    for (int i = 0; i < REGION_NUM * LIST_NUM; ++i) {
         (*(epilogue_list + i)).prev = (segregated_list + i);
         (*(epilogue_list + i)).next = (segregated_list + i + 1);
         SET_SIZE_AND_ALLOC_BIT((epilogue_list + i), 0, ALLOCATED);
@@ -446,12 +850,29 @@ int mm_init(void)
     SET_SIZE_AND_ALLOC_BIT(first_free_block, size, FREE);
     SET_FOOTER(first_free_block, size);
 
-    /* insert first_free_block to segregated free list */
-    int idx = get_list_idx(size);
-    first_free_block->prev = (segregated_list + idx);
-    first_free_block->next = (epilogue_list + idx);
-    (*(segregated_list + idx)).next = first_free_block;
-    (*(epilogue_list + idx)).prev = first_free_block;
+    /* the first free memory block spans the whole heap, so it is the wilderness */
+    wilderness = first_free_block;
+
+    /* reset the growth controller */
+    growth_chunk = GROWTH_MIN_CHUNK;
+    malloc_count = 0;
+    last_extend_count = 0;
+
+#if LIFETIME_SEGREGATION
+    /* reset the lifetime predictor */
+    op_clock = 0;
+    spare_arena = NULL;
+    memset(lifetime_avg, 0, sizeof(lifetime_avg));
+    memset(lifetime_samples, 0, sizeof(lifetime_samples));
+#endif
+
+    /* the sampled objects of the old heap are gone (the sampling interval is kept) */
+    memset(sample_table, 0, sizeof(sample_table));
+    sample_count = 0;
+
+#ifdef MM_STATS
+    memset(&arena_counters, 0, sizeof(arena_counters));
+#endif
 
     return 0;
 }
@@ -464,6 +885,24 @@ int mm_init(void)
  * @return: the start address of requested memory space
  */
 void *mm_malloc(size_t size) 
+{
+    void *bp = malloc_payload(size);
+
+    /* the only cost of the heap profiler for an allocation that isn't sampled */
+    if (bp != NULL && (sample_countdown -= (long) size) < 0) {
+        profile_sample(bp, size);
+    }
+
+    return bp;
+}
+
+/*
+ * malloc_payload - mm_malloc without the heap profiler, for the callers that sample the block they return themselves
+ *
+ * @size: the size (in byte) to allocate
+ * @return: the start address of requested memory space
+ */
+static void *malloc_payload(size_t size)
 {
     /* if heap_listp == 0, this means this is the first call of mm_malloc, so we call mm_init */
     if (heap_listp == 0) {
@@ -475,28 +914,15 @@ void *mm_malloc(size_t size)
     }
 
     size_t adjusted_size = adjust_size(size);
+    malloc_count++;
+#if LIFETIME_SEGREGATION
+    op_clock++;
+#endif
+    STATS_ADD(mallocs, 1);
 
-    Header *block_ptr = find_block(&adjusted_size);
-
-    /* can't find big enough free memory block, extend the heap */
+    Header *block_ptr = allocate_block(adjusted_size, predict_region(adjusted_size));
     if (block_ptr == NULL) {
-        size_t extend_size = MAX(adjusted_size, CHUNKSIZE);
-        if ((block_ptr = extend_heap(extend_size/WSIZE)) == NULL) {
-            return NULL;
-        }
-    }
-    else {
-        /* if a free block is found, remove it from the free list */
-        block_ptr->prev->next = block_ptr->next;
-        block_ptr->next->prev = block_ptr->prev;
-    }
-    
-    /* set the alloc_bit of the block as allocated */
-    SET_SIZE_AND_ALLOC_BIT(block_ptr, GET_SIZE(block_ptr), ALLOCATED);
-
-    /* if the remaining space is >= MIN_BLOCK_SIZE, split the memroy block */
-    if ((GET_SIZE(block_ptr) - adjusted_size) >= MIN_BLOCK_SIZE) {
-        split_block(block_ptr, &adjusted_size);
+        return NULL;
     }
 
     return (((void *) block_ptr) + HEADER_SIZE);
@@ -516,13 +942,41 @@ void mm_free(void *bp)
 
     /* get the address of the header of the block */
     Header *header = (void *) (((uint8_t *) bp) - HEADER_SIZE);
+#if LIFETIME_SEGREGATION
+    int region = header->region;
+
+    op_clock++;
+    record_lifetime(header);
+#else
+    int region = LONG_REGION;
+#endif
+
+    STATS_ADD(frees, 1);
+
+    if (header->flags & SAMPLED_FLAG) {
+        profile_forget(bp);
+    }
 
     /* set the alloc_bit of the block as free */
     SET_SIZE_AND_ALLOC_BIT(header, GET_SIZE(header), FREE);
 
-    /* insert the block to free memory block list */
     header = coalesce(header);
-    insert_segregated_list(header);
+
+#if LIFETIME_SEGREGATION
+    /* if the whole short-lived arena is empty now, keep it as the spare arena or give it back to the long-lived region */
+    if (region == SHORT_REGION && is_fence((Header *) GET_PRV_BLOCK_ADDR(header)) && is_fence((Header *) GET_NXT_BLOCK_ADDR(header))) {
+        if (spare_arena == NULL) {
+            spare_arena = header;
+        }
+        else {
+            release_short_arena(header);
+            return;
+        }
+    }
+#endif
+
+    /* insert the block to free memory block list (or let it become the wilderness) */
+    insert_free_block(header, region);
 }
 
 /*
@@ -555,8 +1009,8 @@ void *mm_realloc(void *ptr, size_t size)
         return new_ptr;
     }
 
-    /* Copy the old data. */
-    size_t old_size = GET_SIZE(header);
+    /* Copy the old data (only the payload, not the Header and Footer around it). */
+    size_t old_size = mm_usable_size(ptr);
     if (size < old_size) {
         old_size = size;
     }
@@ -566,4 +1020,283 @@ void *mm_realloc(void *ptr, size_t size)
     mm_free(ptr);
 
     return new_ptr;
-}
\ No newline at end of file
+}
+
+/*
+ * mm_memalign - allocate a block whose payload address is a multiple of alignment
+ *      a bigger block is allocated, and the part in front of the aligned payload is split off and freed again
+ *
+ * @alignment: a power of 2
+ * @size: the size (in byte) to allocate
+ * @return: the aligned start address of requested memory space, or NULL
+ */
+void *mm_memalign(size_t alignment, size_t size)
+{
+    if (alignment <= ALIGNMENT) {
+        return mm_malloc(size);
+    }
+
+    /* leave room for a free block of at least MIN_BLOCK_SIZE in front of the aligned payload */
+    uint8_t *bp = malloc_payload(size + alignment + MIN_BLOCK_SIZE);
+    if (bp == NULL) {
+        return NULL;
+    }
+    if ((((uintptr_t) bp) & (alignment - 1)) != 0) {
+        bp = align_payload(bp, alignment);
+    }
+
+    /* the profiler is charged, and samples, the block the user gets, as in mm_malloc */
+    if ((sample_countdown -= (long) size) < 0) {
+        profile_sample(bp, size);
+    }
+
+    return bp;
+}
+
+/*
+ * align_payload - split off the front of an allocated block, so that its payload address becomes a multiple of alignment
+ *      the block must be big enough for a free block of at least MIN_BLOCK_SIZE in front of the aligned payload
+ *
+ * @bp: the payload address of the block
+ * @alignment: a power of 2
+ * @return: the aligned payload address
+ */
+static uint8_t *align_payload(uint8_t *bp, size_t alignment)
+{
+    uint8_t *aligned_bp = (uint8_t *) ((((uintptr_t) bp) + MIN_BLOCK_SIZE + alignment - 1) & ~((uintptr_t) alignment - 1));
+    Header *header = (void *) (bp - HEADER_SIZE);
+    Header *aligned_header = (void *) (aligned_bp - HEADER_SIZE);
+    size_t front_size = (size_t) (aligned_bp - bp);
+    size_t aligned_size = GET_SIZE(header) - front_size;
+
+    SET_SIZE_AND_ALLOC_BIT(aligned_header, aligned_size, ALLOCATED);
+    SET_FOOTER(aligned_header, aligned_size);
+#if LIFETIME_SEGREGATION
+    aligned_header->birth = header->birth;
+    aligned_header->region = header->region;
+#endif
+    aligned_header->flags = 0;
+
+    SET_SIZE_AND_ALLOC_BIT(header, front_size, ALLOCATED);
+    SET_FOOTER(header, front_size);
+    header->flags = 0;
+    mm_free(bp);
+
+    return aligned_bp;
+}
+
+/*
+ * mm_usable_size - return the number of bytes that can be used in an allocated block
+ *
+ * @ptr: a payload address returned by mm_malloc, mm_realloc or mm_memalign
+ */
+size_t mm_usable_size(void *ptr)
+{
+    Header *header = (void *) (((uint8_t *) ptr) - HEADER_SIZE);
+    return GET_SIZE(header) - HEADER_SIZE - FOOTER_SIZE;
+}
+
+/*
+ * mm_get_stats - report the current state of the heap
+ *      the gauges are computed here from the free lists, so keeping them costs nothing in mm_malloc and mm_free
+ *      the event counters are copied from the heap's counters (only maintained with -DMM_STATS)
+ *
+ * @stats: filled in with the statistics
+ */
+void mm_get_stats(struct mm_stats *stats)
+{
+    size_t total_free = 0;
+
+    _Static_assert(MM_STATS_BINS == REGION_NUM * LIST_NUM, "MM_STATS_BINS must match the segregated lists");
+
+#ifdef MM_STATS
+    *stats = arena_counters;
+#else
+    memset(stats, 0, sizeof(*stats));
+#endif
+
+    if (heap_listp == 0) {
+        return;
+    }
+
+    /* walk every segregated list */
+    for (int i = 0; i < REGION_NUM * LIST_NUM; ++i) {
+        Header *iterator = segregated_list[i].next, *epilogue = (epilogue_list + i);
+        stats->free_bytes[i] = 0;
+        while (iterator != epilogue) {
+            stats->free_bytes[i] += GET_SIZE(iterator);
+            stats->largest_free = MAX(stats->largest_free, (size_t) GET_SIZE(iterator));
+            iterator = iterator->next;
+        }
+        total_free += stats->free_bytes[i];
+    }
+
+    stats->wilderness_bytes = (wilderness == NULL) ? 0 : GET_SIZE(wilderness);
+    stats->largest_free = MAX(stats->largest_free, stats->wilderness_bytes);
+    total_free += stats->wilderness_bytes;
+
+    stats->heap_size = mem_heapsize();
+    stats->live_bytes = ((size_t) mem_heap_hi()) + 1 - ((size_t) heap_listp) - total_free;
+    stats->ext_fragmentation = (total_free == 0) ? 0.0 : 1.0 - ((double) stats->largest_free / (double) total_free);
+    stats->sbrk_calls = mem_sbrk_calls();
+}
+
+/*
+ * next_sample_interval - draw the number of bytes until the next sampled allocation
+ *      the intervals are exponentially distributed with mean sample_interval, so every byte is equally likely to be sampled
+ */
+static long next_sample_interval(void)
+{
+    if (sample_interval == 0) {
+        return LONG_MAX;
+    }
+
+    /* xorshift32, then map to (0, 1] */
+    sample_rng ^= sample_rng << 13;
+    sample_rng ^= sample_rng >> 17;
+    sample_rng ^= sample_rng << 5;
+    double u = ((double) (sample_rng >> 8) + 1.0) / (double) (1 << 24);
+
+    double interval = -log(u) * (double) sample_interval;
+    return (interval >= (double) LONG_MAX) ? LONG_MAX : (long) interval;
+}
+
+/*
+ * sample_slot - find the slot of sample_table holding bp, or the empty slot where bp would go
+ *      (linear probing, the table is never completely full)
+ */
+static int sample_slot(void *bp)
+{
+    int idx = (int) ((((size_t) bp) >> 3) * 2654435761u) & (PROFILE_TABLE_SIZE - 1);
+
+    while (sample_table[idx].ptr != NULL && sample_table[idx].ptr != bp) {
+        idx = (idx + 1) & (PROFILE_TABLE_SIZE - 1);
+    }
+    return idx;
+}
+
+/*
+ * profile_sample - record a sampled allocation in the side table, with the call chain that allocated it
+ *      the block is marked with SAMPLED_FLAG, so mm_free only looks at the table for sampled blocks
+ *      when the table is full, the sample is dropped
+ *
+ * @bp: the payload address returned to the user
+ * @size: the requested size
+ */
+static void profile_sample(void *bp, size_t size)
+{
+    sample_countdown = next_sample_interval();
+
+    if (sample_interval == 0 || sample_count >= PROFILE_TABLE_SIZE - 1) {
+        return;
+    }
+
+    Sample *sample = sample_table + sample_slot(bp);
+    sample->ptr = bp;
+    sample->size = size;
+    sample->depth = backtrace(sample->stack, PROFILE_MAX_DEPTH);
+    sample_count++;
+
+    ((Header *) (((uint8_t *) bp) - HEADER_SIZE))->flags |= SAMPLED_FLAG;
+}
+
+/*
+ * profile_forget - remove a freed object from the side table
+ *      the slots following it are shifted back so linear probing keeps working without tombstones
+ *
+ * @bp: the payload address of the sampled object
+ */
+static void profile_forget(void *bp)
+{
+    int hole = sample_slot(bp);
+    if (sample_table[hole].ptr == NULL) {
+        return;
+    }
+
+    sample_table[hole].ptr = NULL;
+    sample_count--;
+
+    for (int idx = (hole + 1) & (PROFILE_TABLE_SIZE - 1); sample_table[idx].ptr != NULL; idx = (idx + 1) & (PROFILE_TABLE_SIZE - 1)) {
+        int home = sample_slot(sample_table[idx].ptr);
+        if (home != idx) {
+            sample_table[home] = sample_table[idx];
+            sample_table[idx].ptr = NULL;
+        }
+    }
+}
+
+/*
+ * mm_profile_start - start (or stop) the sampling heap profiler
+ *
+ * @mean_interval: mean number of allocated bytes between two samples, 0 stops sampling
+ *                 (objects that are already sampled stay in the profile until they are freed)
+ */
+void mm_profile_start(size_t mean_interval)
+{
+    void *warm_up[1];
+
+    /* backtrace may allocate the first time it is called, make sure that happens now and not in mm_malloc */
+    backtrace(warm_up, 1);
+
+    sample_interval = mean_interval;
+    sample_countdown = next_sample_interval();
+}
+
+/*
+ * mm_profile_dump - write the sampled live objects as a pprof legacy heap profile
+ *      objects with the same call chain are reported together, and the counts are raw samples
+ *      (pprof scales them back up with the heap_v2 sampling interval in the first line)
+ *      only live objects are tracked, so the allocation columns repeat the in-use ones
+ *
+ * @out: the stream to write the profile to
+ * @return: the number of sampled objects written
+ */
+int mm_profile_dump(FILE *out)
+{
+    static bool reported[PROFILE_TABLE_SIZE];
+    size_t total_bytes = 0;
+    FILE *maps;
+    int c;
+
+    for (int i = 0; i < PROFILE_TABLE_SIZE; ++i) {
+        total_bytes += (sample_table[i].ptr != NULL) ? sample_table[i].size : 0;
+        reported[i] = false;
+    }
+
+    fprintf(out, "heap profile: %d: %zu [%d: %zu] @ heap_v2/%zu\n", sample_count, total_bytes, sample_count, total_bytes, sample_interval);
+
+    /* group the samples by call chain */
+    for (int i = 0; i < PROFILE_TABLE_SIZE; ++i) {
+        if (sample_table[i].ptr == NULL || reported[i]) {
+            continue;
+        }
+
+        int objects = 0;
+        size_t bytes = 0;
+        for (int j = i; j < PROFILE_TABLE_SIZE; ++j) {
+            if (sample_table[j].ptr != NULL && !reported[j] && sample_table[j].depth == sample_table[i].depth &&
+                memcmp(sample_table[j].stack, sample_table[i].stack, sample_table[i].depth * sizeof(void *)) == 0) {
+                reported[j] = true;
+                objects++;
+                bytes += sample_table[j].size;
+            }
+        }
+
+        fprintf(out, "%d: %zu [%d: %zu] @", objects, bytes, objects, bytes);
+        for (int d = 0; d < sample_table[i].depth; ++d) {
+            fprintf(out, " %p", sample_table[i].stack[d]);
+        }
+        fprintf(out, "\n");
+    }
+
+    /* pprof needs the memory map to symbolize the addresses */
+    fprintf(out, "\nMAPPED_LIBRARIES:\n");
+    if ((maps = fopen("/proc/self/maps", "r")) != NULL) {
+        while ((c = fgetc(maps)) != EOF) {
+            fputc(c, out);
+        }
+        fclose(maps);
+    }
+
+    return sample_count;
+}
@@ -4,9 +4,59 @@ extern int mm_init (void);
 extern void *mm_malloc (size_t size);
 extern void mm_free (void *ptr);
 extern void *mm_realloc(void *ptr, size_t size);
+extern void *mm_memalign(size_t alignment, size_t size);
+extern size_t mm_usable_size(void *ptr);
 extern void print_free_list();
 extern void print_heap();
 
+/*
+ * Allocator statistics returned by mm_get_stats. The gauges are computed
+ * from the free lists when mm_get_stats is called. The event counters
+ * are only maintained when mm.c is compiled with -DMM_STATS, otherwise
+ * they are always 0 and cost nothing at run time.
+ */
+#if LIFETIME_SEGREGATION
+#define MM_STATS_BINS 14  /* segregated lists in mm.c (both regions) */
+#else
+#define MM_STATS_BINS 7   /* segregated lists in mm.c */
+#endif
+#define MM_HIST_BUCKETS 12 /* bucket i > 0 counts values in [2^(i-1), 2^i) */
+
+struct mm_stats {
+    /* gauges */
+    size_t live_bytes;              /* bytes in allocated blocks, incl. headers/footers */
+    size_t heap_size;               /* bytes obtained with mem_sbrk */
+    size_t free_bytes[MM_STATS_BINS]; /* bytes in each segregated list */
+    size_t wilderness_bytes;        /* bytes in the free block at the end of the heap */
+    size_t largest_free;            /* largest free block (incl. the wilderness) */
+    double ext_fragmentation;       /* 1 - largest_free / total free bytes */
+    unsigned long sbrk_calls;       /* mem_sbrk calls since the heap was reset */
+
+    /* event counters (MM_STATS builds only) */
+    unsigned long mallocs;          /* mm_malloc calls */
+    unsigned long frees;            /* mm_free calls */
+    unsigned long splits;           /* blocks split by split_block */
+    unsigned long coalesces;        /* neighbouring blocks merged by coalesce */
+    unsigned long find_calls;       /* find_block calls */
+    unsigned long find_nodes;       /* free blocks visited by find_block */
+    unsigned long find_misses;      /* find_block calls that found no block */
+
+    /* histograms per find_block call (MM_STATS builds only) */
+    unsigned long find_nodes_hist[MM_HIST_BUCKETS]; /* free blocks visited (log2 buckets) */
+    unsigned long find_bins_hist[MM_HIST_BUCKETS];  /* lists probed (bucket i = i lists) */
+};
+
+extern void mm_get_stats(struct mm_stats *stats);
+
+/*
+ * Sampling heap profiler. mm_profile_start(mean) samples on average one
+ * allocation every mean bytes (0 stops sampling). mm_profile_dump writes
+ * the sampled live objects in the pprof legacy heap profile text format
+ * and returns the number of sampled objects written.
+ */
+extern void mm_profile_start(size_t mean_interval);
+extern int mm_profile_dump(FILE *out);
+
 
 /* 
  * Students work in teams of one or two.  Teams enter their team name, 
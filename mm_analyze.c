@@ -0,0 +1,637 @@
+/*
+ * mm_analyze.c - reports the size, lifetime and concurrency profile of
+ *     traces, and the size-class occupancy that mm.c's segregated lists
+ *     would see on them, to help choose LIST_NUM, min_threshold,
+ *     max_threshold and CHUNKSIZE:
+ *
+ *         make mm_analyze
+ *         ./mm_analyze tracefiles/realloc-bal.rep
+ *         ./mm_analyze -g 64 -l 5,7,9 -k 8 tracefiles/binary-bal.rep
+ *
+ *     For each trace it prints the request sizes, the lifetimes of the
+ *     blocks in ops, the live bytes and objects over time, the realloc
+ *     chains, and then, for each list count given with -l, the classes
+ *     that mm.c's get_list_idx would put the blocks in. The last table
+ *     gives the class bounds that would split the requests into equal
+ *     parts, for comparison with the power-of-2 classes.
+ *
+ *     A lifetime is the number of trace ops from the alloc of a block
+ *     to its free. In the class tables, a realloc ends the life of the
+ *     block in its old class and starts one in the new class.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "trace.h"
+
+int verbose = 0; /* read by trace.c */
+
+#define BUCKETS     33      /* log2 buckets: 0, 1, 2-3, 4-7, ..., 2^31- */
+#define MAX_LAYOUTS 8       /* list counts given with -l */
+#define MAX_LISTS   16
+#define LIST_NUM    7       /* mm.c's list count, the default layout */
+#define CHUNKSIZE   (1 << 12)
+#define POINTS      20      /* default points of the live-bytes timeline */
+#define TOP_SIZES   10      /* most frequent exact request sizes shown */
+#define BAR_WIDTH   40
+
+/*
+ * The block geometry of mm.c: ALIGNMENT is 2 * sizeof(size_t), and the
+ * header and footer are rounded up to it. The driver is built with -m32.
+ */
+typedef struct {
+    char *name;
+    int align;
+    int header, footer;
+} geometry_t;
+
+static geometry_t geometries[] = {
+    { "32", 8, 16, 8 },
+    { "64", 16, 32, 16 },
+};
+
+/* One alloc or realloc of the trace: the block it makes */
+typedef struct {
+    int size;        /* payload size requested */
+    int op;          /* op that made it */
+    int end;         /* op that freed or reallocated it, or -1 */
+} req_t;
+
+static geometry_t *geom = &geometries[0];
+
+static void usage(void)
+{
+    fprintf(stderr, "Usage: mm_analyze [-h] [-g 32|64] [-l <n>,...] [-k <classes>] [-n <points>] <trace>...\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-g 32|64     Block geometry of a -m32 or a 64-bit build (default 32).\n");
+    fprintf(stderr, "\t-h           Print this message.\n");
+    fprintf(stderr, "\t-k <n>       Suggest <n> equal-count classes (default: each -l count).\n");
+    fprintf(stderr, "\t-l <n>,...   List counts to model (default %d, mm.c's LIST_NUM).\n", LIST_NUM);
+    fprintf(stderr, "\t-n <points>  Points of the live-bytes timeline (default %d).\n", POINTS);
+}
+
+static void unix_error(char *msg)
+{
+    fprintf(stderr, "%s: %s\n", msg, strerror(errno));
+    exit(1);
+}
+
+static int cmp_int(const void *a, const void *b)
+{
+    int x = *(const int *)a, y = *(const int *)b;
+    return (x > y) - (x < y);
+}
+
+/*
+ * log2_bucket - the bucket of x: 0 for 0, else 1 + floor(log2(x))
+ */
+static int log2_bucket(unsigned int x)
+{
+    int b = 0;
+
+    while (x > 0) {
+	b++;
+	x >>= 1;
+    }
+    return b;
+}
+
+static void bucket_label(int b, char *buf)
+{
+    if (b == 0)
+	sprintf(buf, "0");
+    else if (b == 1)
+	sprintf(buf, "1");
+    else if (b == BUCKETS - 1)
+	sprintf(buf, "%u-", 1u << (b - 1));
+    else
+	sprintf(buf, "%u-%u", 1u << (b - 1), (1u << b) - 1);
+}
+
+/*
+ * nearest_exponent - ceil(log2(x)), as in mm.c
+ */
+static int nearest_exponent(unsigned int x)
+{
+    int e = 0;
+
+    for (x -= 1; x > 0; x >>= 1)
+	e++;
+    return e;
+}
+
+/*
+ * adjust_size - the block size mm.c uses for a payload of size bytes
+ */
+static int adjust_size(int size)
+{
+    size += geom->header + geom->footer;
+    return (size + geom->align - 1) & ~(geom->align - 1);
+}
+
+/*
+ * class_of - the list mm.c's get_list_idx puts a block in, with nlists
+ *     lists
+ */
+static int class_of(int block_size, int nlists)
+{
+    int lowest = nearest_exponent(geom->header + geom->footer + 8);
+
+    if (block_size <= (1 << lowest))
+	return 0;
+    if (block_size > (1 << (lowest + nlists - 2)))
+	return nlists - 1;
+    return nearest_exponent(block_size) - lowest;
+}
+
+static void class_label(int c, int nlists, char *buf)
+{
+    int lowest = nearest_exponent(geom->header + geom->footer + 8);
+
+    if (c == 0)
+	sprintf(buf, "<=%d", 1 << lowest);
+    else if (c == nlists - 1)
+	sprintf(buf, ">%d", 1 << (lowest + nlists - 2));
+    else
+	sprintf(buf, "%d-%d", (1 << (lowest + c - 1)) + 1, 1 << (lowest + c));
+}
+
+static void print_bar(double x, double max)
+{
+    int i, n = (max > 0) ? (int)(BAR_WIDTH * x / max + 0.5) : 0;
+
+    for (i = 0; i < n; i++)
+	putchar('#');
+}
+
+/*
+ * print_sizes - histogram of the request sizes, and the most frequent ones
+ */
+static void print_sizes(req_t *reqs, int num_reqs)
+{
+    long long count[BUCKETS] = {0}, bytes[BUCKETS] = {0}, total = 0, cum = 0;
+    long long big = 0;
+    int *sizes, i, j, b, top, n;
+    int top_size[TOP_SIZES], top_count[TOP_SIZES];
+    char label[32];
+
+    if (num_reqs == 0)
+	return;
+    for (i = 0; i < num_reqs; i++) {
+	b = log2_bucket(reqs[i].size);
+	count[b]++;
+	bytes[b] += reqs[i].size;
+	total += reqs[i].size;
+	if (reqs[i].size > CHUNKSIZE)
+	    big++;
+    }
+
+    printf("Request sizes (allocs and reallocs), %.1f bytes on average:\n",
+	   (double)total / num_reqs);
+    printf("%22s %9s %7s %7s %7s\n", "bytes", "requests", "%", "cum%", "bytes%");
+    for (b = 0; b < BUCKETS; b++) {
+	if (count[b] == 0)
+	    continue;
+	cum += count[b];
+	bucket_label(b, label);
+	printf("%22s %9lld %6.1f%% %6.1f%% %6.1f%%\n", label, count[b],
+	       100.0 * count[b] / num_reqs, 100.0 * cum / num_reqs,
+	       total ? 100.0 * bytes[b] / total : 0.0);
+    }
+    printf("%lld requests (%.1f%%) are larger than CHUNKSIZE (%d bytes)\n",
+	   big, 100.0 * big / num_reqs, CHUNKSIZE);
+
+    /* The most frequent exact sizes, from runs of the sorted sizes */
+    if ((sizes = (int *)malloc(num_reqs * sizeof(int))) == NULL)
+	unix_error("malloc failed in print_sizes");
+    for (i = 0; i < num_reqs; i++)
+	sizes[i] = reqs[i].size;
+    qsort(sizes, num_reqs, sizeof(int), cmp_int);
+    top = 0;
+    for (i = 0; i < num_reqs; i += n) {
+	for (n = 1; i + n < num_reqs && sizes[i + n] == sizes[i]; n++)
+	    ;
+	/* insert the run, keeping top_count[] in decreasing order */
+	for (j = top; j > 0 && top_count[j - 1] < n; j--)
+	    if (j < TOP_SIZES) {
+		top_count[j] = top_count[j - 1];
+		top_size[j] = top_size[j - 1];
+	    }
+	if (j < TOP_SIZES) {
+	    top_count[j] = n;
+	    top_size[j] = sizes[i];
+	    if (top < TOP_SIZES)
+		top++;
+	}
+    }
+    printf("Most frequent sizes:");
+    for (j = 0; j < top; j++)
+	printf(" %d (%.1f%%)", top_size[j], 100.0 * top_count[j] / num_reqs);
+    printf("\n\n");
+    free(sizes);
+}
+
+/*
+ * print_lifetimes - histogram of the block lifetimes, alloc to free
+ */
+static void print_lifetimes(int *life, int num_objs)
+{
+    long long count[BUCKETS] = {0}, cum = 0, never = 0, freed;
+    int i, b;
+    char label[32];
+
+    if (num_objs == 0)
+	return;
+    for (i = 0; i < num_objs; i++) {
+	if (life[i] < 0)
+	    never++;
+	else
+	    count[log2_bucket(life[i])]++;
+    }
+    freed = num_objs - never;
+
+    printf("Lifetimes in ops (alloc to free):\n");
+    printf("%22s %9s %7s %7s\n", "ops", "blocks", "%", "cum%");
+    for (b = 0; b < BUCKETS; b++) {
+	if (count[b] == 0)
+	    continue;
+	cum += count[b];
+	bucket_label(b, label);
+	printf("%22s %9lld %6.1f%% %6.1f%%\n", label, count[b],
+	       100.0 * count[b] / num_objs, 100.0 * cum / num_objs);
+    }
+    if (never)
+	printf("%22s %9lld %6.1f%%\n", "never freed", never,
+	       100.0 * never / num_objs);
+    if (freed) {
+	qsort(life, num_objs, sizeof(int), cmp_int);
+	/* never-freed blocks (-1) sort first */
+	printf("Median lifetime %d ops, 90th percentile %d ops\n",
+	       life[never + (freed - 1) / 2], life[never + (9 * (freed - 1)) / 10]);
+    }
+    printf("\n");
+}
+
+/*
+ * print_chains - histogram of the number of reallocs of each block
+ */
+static void print_chains(int *chain, int num_ids)
+{
+    long long count[BUCKETS] = {0}, chains = 0, links = 0;
+    int i, b, longest = 0;
+    char label[32];
+
+    for (i = 0; i < num_ids; i++) {
+	if (chain[i] == 0)
+	    continue;
+	count[log2_bucket(chain[i])]++;
+	chains++;
+	links += chain[i];
+	if (chain[i] > longest)
+	    longest = chain[i];
+    }
+    if (chains == 0) {
+	printf("No reallocs\n\n");
+	return;
+    }
+
+    printf("Realloc chains (reallocs per block), %lld chains, %.1f on average, longest %d:\n",
+	   chains, (double)links / chains, longest);
+    printf("%22s %9s %7s\n", "reallocs", "blocks", "%");
+    for (b = 1; b < BUCKETS; b++) {
+	if (count[b] == 0)
+	    continue;
+	bucket_label(b, label);
+	printf("%22s %9lld %6.1f%%\n", label, count[b], 100.0 * count[b] / chains);
+    }
+    printf("\n");
+}
+
+/*
+ * print_classes - the occupancy of the classes of mm.c's lists, with
+ *     nlists lists, over the trace
+ */
+static void print_classes(trace_t *trace, req_t *reqs, int num_reqs,
+			  int *req_of, int nlists)
+{
+    long long allocs[MAX_LISTS] = {0}, payload[MAX_LISTS] = {0}, block[MAX_LISTS] = {0};
+    long long live[MAX_LISTS] = {0}, live_bytes[MAX_LISTS] = {0};
+    long long peak[MAX_LISTS] = {0}, peak_bytes[MAX_LISTS] = {0};
+    int *cls, *life, *cur, i, c, n, adj;
+    traceop_t *op;
+    char label[32];
+
+    if ((cls = (int *)malloc((num_reqs + 1) * sizeof(int))) == NULL ||
+	(life = (int *)malloc((num_reqs + 1) * sizeof(int))) == NULL ||
+	(cur = (int *)malloc((trace->num_ids + 1) * sizeof(int))) == NULL)
+	unix_error("malloc failed in print_classes");
+    for (i = 0; i < num_reqs; i++) {
+	adj = adjust_size(reqs[i].size);
+	c = cls[i] = class_of(adj, nlists);
+	allocs[c]++;
+	payload[c] += reqs[i].size;
+	block[c] += adj;
+    }
+
+    /* Replay the trace by class: req_of[i] is the block op i makes */
+    for (i = 0; i <= trace->num_ids; i++)
+	cur[i] = -1;
+    for (i = 0; i < trace->num_ops; i++) {
+	op = &trace->ops[i];
+	if (op->type != ALLOC && op->type != REALLOC && op->type != FREE)
+	    continue;
+	if (op->type != ALLOC && (n = cur[op->index]) >= 0) {
+	    live[cls[n]]--;
+	    live_bytes[cls[n]] -= adjust_size(reqs[n].size);
+	    cur[op->index] = -1;
+	}
+	if (op->type != FREE) {
+	    n = cur[op->index] = req_of[i];
+	    c = cls[n];
+	    live[c]++;
+	    live_bytes[c] += adjust_size(reqs[n].size);
+	    if (live[c] > peak[c])
+		peak[c] = live[c];
+	    if (live_bytes[c] > peak_bytes[c])
+		peak_bytes[c] = live_bytes[c];
+	}
+    }
+
+    printf("Size classes with %d lists (%s-bit blocks: header %d, footer %d, alignment %d):\n",
+	   nlists, geom->name, geom->header, geom->footer, geom->align);
+    printf("%5s %13s %9s %7s %10s %11s %7s %12s\n", "list", "block bytes", "requests",
+	   "%", "peak live", "peak bytes", "frag%", "median life");
+    for (c = 0; c < nlists; c++) {
+	class_label(c, nlists, label);
+	printf("%5d %13s %9lld %6.1f%% %10lld %11lld", c, label, allocs[c],
+	       num_reqs ? 100.0 * allocs[c] / num_reqs : 0.0, peak[c], peak_bytes[c]);
+	if (allocs[c] == 0) {
+	    printf("\n");
+	    continue;
+	}
+	printf(" %6.1f%%", 100.0 * (block[c] - payload[c]) / block[c]);
+
+	/* Median lifetime of the blocks of the class that were freed */
+	for (i = n = 0; i < num_reqs; i++)
+	    if (cls[i] == c && reqs[i].end >= 0)
+		life[n++] = reqs[i].end - reqs[i].op;
+	if (n > 0) {
+	    qsort(life, n, sizeof(int), cmp_int);
+	    printf(" %12d", life[(n - 1) / 2]);
+	} else
+	    printf(" %12s", "-");
+	printf("\n");
+    }
+    printf("\n");
+    free(cls);
+    free(life);
+    free(cur);
+}
+
+/*
+ * print_suggestion - the upper bounds of k classes of block sizes that
+ *     would each get the same number of requests
+ */
+static void print_suggestion(req_t *reqs, int num_reqs, int k)
+{
+    int *adj, i, bound, last = 0;
+
+    if (num_reqs == 0)
+	return;
+    if ((adj = (int *)malloc(num_reqs * sizeof(int))) == NULL)
+	unix_error("malloc failed in print_suggestion");
+    for (i = 0; i < num_reqs; i++)
+	adj[i] = adjust_size(reqs[i].size);
+    qsort(adj, num_reqs, sizeof(int), cmp_int);
+
+    printf("Equal-count bounds for %d classes (block bytes, %d%% of the requests each):\n   ",
+	   k, 100 / k);
+    for (i = 1; i < k; i++) {
+	bound = adj[((long long)i * num_reqs) / k - (((long long)i * num_reqs) / k > 0)];
+	if (bound == last)
+	    continue;   /* a single size fills more than one class */
+	printf(" <=%d", bound);
+	last = bound;
+    }
+    printf(" >%d\n\n", last);
+    free(adj);
+}
+
+/*
+ * analyze_trace - print the profile of one trace
+ */
+static void analyze_trace(char *filename, int *layouts, int num_layouts,
+			  int k, int points)
+{
+    trace_t *trace = read_trace("", filename);
+    traceop_t *op;
+    req_t *reqs;
+    int *req_of, *cur, *birth, *life, *chain, *owner;
+    int num_reqs = 0, num_objs = 0, i, l, t, n, next_point;
+    long long live = 0, live_bytes = 0, peak = 0, peak_bytes = 0;
+    int peak_op = 0, peak_bytes_op = 0;
+    long long *line_objs, *line_bytes, *line_op;
+    long long allocs = 0, frees = 0, reallocs = 0;
+    long long *tops = NULL, *remote = NULL;
+
+    if ((reqs = (req_t *)malloc((trace->num_ops + 1) * sizeof(req_t))) == NULL ||
+	(req_of = (int *)malloc((trace->num_ops + 1) * sizeof(int))) == NULL ||
+	(life = (int *)malloc((trace->num_ops + 1) * sizeof(int))) == NULL ||
+	(cur = (int *)malloc((trace->num_ids + 1) * sizeof(int))) == NULL ||
+	(birth = (int *)calloc(trace->num_ids + 1, sizeof(int))) == NULL ||
+	(chain = (int *)calloc(trace->num_ids + 1, sizeof(int))) == NULL ||
+	(owner = (int *)calloc(trace->num_ids + 1, sizeof(int))) == NULL ||
+	(line_objs = (long long *)calloc(points, sizeof(long long))) == NULL ||
+	(line_bytes = (long long *)calloc(points, sizeof(long long))) == NULL ||
+	(line_op = (long long *)calloc(points, sizeof(long long))) == NULL ||
+	(tops = (long long *)calloc(3 * trace->num_threads, sizeof(long long))) == NULL ||
+	(remote = (long long *)calloc(trace->num_threads, sizeof(long long))) == NULL)
+	unix_error("malloc failed in analyze_trace");
+    for (i = 0; i <= trace->num_ids; i++)
+	cur[i] = -1;
+
+    /*
+     * One pass over the trace: the blocks each op makes, the lifetimes,
+     * the live bytes and objects, and what each thread does
+     */
+    next_point = 0;
+    for (i = 0; i < trace->num_ops; i++) {
+	op = &trace->ops[i];
+	t = trace->tids ? trace->tids[i] : 0;
+	req_of[i] = -1;
+	switch (op->type) {
+	case ALLOC:
+	    allocs++;
+	    tops[3 * t]++;
+	    birth[op->index] = i;
+	    chain[op->index] = 0;
+	    owner[op->index] = t;
+	    break;
+	case REALLOC:
+	    reallocs++;
+	    tops[3 * t + 2]++;
+	    if (cur[op->index] >= 0)
+		chain[op->index]++;
+	    else
+		birth[op->index] = i;   /* a realloc of NULL */
+	    break;
+	case FREE:
+	    frees++;
+	    tops[3 * t + 1]++;
+	    if (cur[op->index] >= 0) {
+		life[num_objs++] = i - birth[op->index];
+		if (owner[op->index] != t)
+		    remote[t]++;
+	    }
+	    break;
+	default:
+	    break;
+	}
+
+	if (op->type == ALLOC || op->type == REALLOC || op->type == FREE) {
+	    if (op->type != ALLOC && (n = cur[op->index]) >= 0) {
+		reqs[n].end = i;
+		live--;
+		live_bytes -= reqs[n].size;
+		cur[op->index] = -1;
+	    }
+	    if (op->type != FREE) {
+		n = cur[op->index] = req_of[i] = num_reqs++;
+		reqs[n].size = op->size;
+		reqs[n].op = i;
+		reqs[n].end = -1;
+		live++;
+		live_bytes += op->size;
+	    }
+	    if (live > peak) {
+		peak = live;
+		peak_op = i;
+	    }
+	    if (live_bytes > peak_bytes) {
+		peak_bytes = live_bytes;
+		peak_bytes_op = i;
+	    }
+	}
+
+	/* Timeline point n is taken after op (n + 1) * num_ops / points - 1 */
+	while (next_point < points &&
+	       i + 1 >= ((long long)(next_point + 1) * trace->num_ops) / points) {
+	    line_op[next_point] = i + 1;
+	    line_objs[next_point] = live;
+	    line_bytes[next_point] = live_bytes;
+	    next_point++;
+	}
+    }
+    /* Blocks still live at the end are never freed */
+    for (i = 0; i <= trace->num_ids; i++)
+	if (cur[i] >= 0)
+	    life[num_objs++] = -1;
+
+    printf("%s: %d ops (%lld allocs, %lld frees, %lld reallocs), %d ids",
+	   filename, trace->num_ops, allocs, frees, reallocs, trace->num_ids);
+    if (trace->num_threads > 1)
+	printf(", %d threads", trace->num_threads);
+    printf("\n\n");
+
+    if (trace->num_threads > 1) {
+	printf("%6s %9s %9s %9s %13s\n", "thread", "allocs", "frees", "reallocs",
+	       "remote frees");
+	for (t = 0; t < trace->num_threads; t++)
+	    printf("%6d %9lld %9lld %9lld %13lld\n", t, tops[3 * t], tops[3 * t + 1],
+		   tops[3 * t + 2], remote[t]);
+	printf("\n");
+    }
+
+    print_sizes(reqs, num_reqs);
+    print_lifetimes(life, num_objs);
+
+    printf("Peak live: %lld bytes (%.1f CHUNKSIZEs) at op %d, %lld objects at op %d\n",
+	   peak_bytes, (double)peak_bytes / CHUNKSIZE, peak_bytes_op, peak, peak_op);
+    printf("%10s %9s %11s\n", "op", "objects", "bytes");
+    for (n = 0; n < next_point; n++) {
+	printf("%10lld %9lld %11lld  ", line_op[n], line_objs[n], line_bytes[n]);
+	print_bar(line_bytes[n], peak_bytes);
+	printf("\n");
+    }
+    printf("\n");
+
+    print_chains(chain, trace->num_ids);
+
+    for (l = 0; l < num_layouts; l++)
+	print_classes(trace, reqs, num_reqs, req_of, layouts[l]);
+    if (k > 0)
+	print_suggestion(reqs, num_reqs, k);
+    else
+	for (l = 0; l < num_layouts; l++)
+	    print_suggestion(reqs, num_reqs, layouts[l]);
+
+    free(reqs);
+    free(req_of);
+    free(life);
+    free(cur);
+    free(birth);
+    free(chain);
+    free(owner);
+    free(line_objs);
+    free(line_bytes);
+    free(line_op);
+    free(tops);
+    free(remote);
+    free_trace(trace);
+}
+
+int main(int argc, char **argv)
+{
+    int c, layouts[MAX_LAYOUTS] = { LIST_NUM }, num_layouts = 1;
+    int k = 0, points = POINTS;
+    char *tok;
+
+    while ((c = getopt(argc, argv, "g:l:k:n:h")) != EOF) {
+	switch (c) {
+	case 'g': /* Block geometry */
+	    if (!strcmp(optarg, "32"))
+		geom = &geometries[0];
+	    else if (!strcmp(optarg, "64"))
+		geom = &geometries[1];
+	    else {
+		usage();
+		exit(1);
+	    }
+	    break;
+	case 'l': /* List counts to model */
+	    num_layouts = 0;
+	    for (tok = strtok(optarg, ","); tok; tok = strtok(NULL, ",")) {
+		if (num_layouts == MAX_LAYOUTS || atoi(tok) < 2 || atoi(tok) > MAX_LISTS) {
+		    fprintf(stderr, "mm_analyze: -l takes up to %d list counts from 2 to %d\n",
+			    MAX_LAYOUTS, MAX_LISTS);
+		    exit(1);
+		}
+		layouts[num_layouts++] = atoi(tok);
+	    }
+	    break;
+	case 'k': /* Classes to suggest */
+	    k = atoi(optarg);
+	    break;
+	case 'n': /* Timeline points */
+	    points = atoi(optarg);
+	    break;
+	case 'h':
+	    usage();
+	    exit(0);
+	default:
+	    usage();
+	    exit(1);
+	}
+    }
+    if (optind == argc || num_layouts == 0 || k < 0 || k == 1 || points < 1) {
+	usage();
+	exit(1);
+    }
+
+    for (; optind < argc; optind++)
+	analyze_trace(argv[optind], layouts, num_layouts, k, points);
+    exit(0);
+}
@@ -0,0 +1,560 @@
+/*
+ * mm_bench.c - the classic multithreaded allocator benchmarks, run
+ *     against the mm package and against libc malloc:
+ *
+ *         make mm_bench
+ *         ./mm_bench                      # everything, 1..#cpus threads
+ *         ./mm_bench -b larson -n 16 -d 2
+ *         ./mm_bench -a mm -c > mm.csv    # CSV output
+ *
+ *     larson         server-style churn: each thread frees and replaces
+ *                    random blocks of a set of slots, and the sets move
+ *                    on to another thread every round, so most frees are
+ *                    of blocks allocated by another thread (timed, -d)
+ *     threadtest     each thread allocates a batch of small objects and
+ *                    frees them all, over and over; the work is split
+ *                    among the threads (-i)
+ *     xmalloc        producer/consumer pairs: producers allocate batches
+ *                    of blocks that consumers free (timed, -d)
+ *     cache-thrash   each thread allocates a small object, writes it
+ *                    many times and frees it: active false sharing if
+ *                    the allocator puts the threads' objects on the same
+ *                    cache line (-i)
+ *     cache-scratch  like cache-thrash, but each thread starts by freeing
+ *                    an object that the main thread allocated next to the
+ *                    others': passive false sharing (-i)
+ *
+ *     mm.c is not thread-safe, so the mm allocator runs it behind one
+ *     global lock (like libmm.so), on a heap from memlib_mmap.c that is
+ *     reset between runs. Each run prints the benchmark, allocator,
+ *     threads, seconds, allocator calls and millions of calls per
+ *     second, as a table or (with -c) as CSV.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+
+#include "mm.h"
+#include "memlib.h"
+
+#define MAX_THREADS  256
+
+/* An allocator under test */
+typedef struct {
+    char *name;
+    void *(*malloc)(size_t size);
+    void (*free)(void *ptr);
+} allocator_t;
+
+/* The parameters of a run, shared by its threads */
+typedef struct {
+    allocator_t *alloc;
+    int threads;
+    double duration;          /* secs, for the timed benchmarks */
+    long iterations;          /* work, for the others */
+    pthread_barrier_t start;  /* lets all the threads go at once */
+    volatile int stop;        /* set when a timed run is over */
+} run_t;
+
+/* One benchmark thread */
+typedef struct {
+    run_t *run;
+    int id;
+    long ops;                 /* malloc and free calls it made */
+} thread_t;
+
+/* A benchmark: its thread body, and an optional setup/teardown */
+typedef struct {
+    char *name;
+    void *(*body)(void *);
+    void (*setup)(run_t *run);
+    void (*teardown)(run_t *run);
+} bench_t;
+
+
+/*****************
+ * The allocators
+ *****************/
+
+static pthread_mutex_t mm_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void *mm_locked_malloc(size_t size)
+{
+    void *p;
+
+    pthread_mutex_lock(&mm_lock);
+    p = mm_malloc(size);
+    pthread_mutex_unlock(&mm_lock);
+    return p;
+}
+
+static void mm_locked_free(void *ptr)
+{
+    pthread_mutex_lock(&mm_lock);
+    mm_free(ptr);
+    pthread_mutex_unlock(&mm_lock);
+}
+
+static allocator_t allocators[] = {
+    {"libc", malloc, free},
+    {"mm", mm_locked_malloc, mm_locked_free},
+    {NULL, NULL, NULL}
+};
+
+
+/*****************
+ * Helper routines
+ *****************/
+
+static void unix_error(char *msg)
+{
+    fprintf(stderr, "%s: %s\n", msg, strerror(errno));
+    exit(1);
+}
+
+static void *bench_malloc(allocator_t *a, size_t size)
+{
+    void *p = a->malloc(size);
+
+    if (p == NULL) {
+	fprintf(stderr, "%s malloc(%zu) failed\n", a->name, size);
+	exit(1);
+    }
+    return p;
+}
+
+/* xorshift, one state per thread */
+static unsigned rnd(unsigned *state)
+{
+    unsigned x = *state;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+/****************************************************************
+ * larson. Slot sets are passed around the threads: in round r,
+ * thread i works on set (i + r) % threads. All threads finish a
+ * round before the sets move on.
+ ****************************************************************/
+
+#define LARSON_SLOTS  1000  /* blocks in each set */
+#define LARSON_ROUND 10000  /* replacements per round */
+#define LARSON_MIN      16  /* block sizes */
+#define LARSON_MAX     128
+
+static char **larson_sets[MAX_THREADS];
+static pthread_barrier_t larson_round;
+
+static void larson_setup(run_t *run)
+{
+    unsigned seed = 12345;
+    int i, j;
+
+    pthread_barrier_init(&larson_round, NULL, run->threads);
+    for (i = 0; i < run->threads; i++) {
+	if ((larson_sets[i] = (char **)calloc(LARSON_SLOTS, sizeof(char *))) == NULL)
+	    unix_error("calloc failed in larson_setup");
+	for (j = 0; j < LARSON_SLOTS; j++)
+	    larson_sets[i][j] = bench_malloc(run->alloc, LARSON_MIN +
+					rnd(&seed) % (LARSON_MAX - LARSON_MIN));
+    }
+}
+
+static void larson_teardown(run_t *run)
+{
+    int i, j;
+
+    for (i = 0; i < run->threads; i++) {
+	for (j = 0; j < LARSON_SLOTS; j++)
+	    run->alloc->free(larson_sets[i][j]);
+	free(larson_sets[i]);
+    }
+    pthread_barrier_destroy(&larson_round);
+}
+
+static void *larson(void *arg)
+{
+    thread_t *t = (thread_t *)arg;
+    run_t *run = t->run;
+    allocator_t *a = run->alloc;
+    unsigned seed = 2 * t->id + 1;
+    double end;
+    char **set;
+    int r, i, k;
+
+    pthread_barrier_wait(&run->start);
+    end = now() + run->duration;
+    for (r = 0; ; r++) {
+	set = larson_sets[(t->id + r) % run->threads];
+	for (i = 0; i < LARSON_ROUND; i++) {
+	    k = rnd(&seed) % LARSON_SLOTS;
+	    a->free(set[k]);
+	    set[k] = bench_malloc(a, LARSON_MIN + rnd(&seed) % (LARSON_MAX - LARSON_MIN));
+	    set[k][0] = (char)k;
+	}
+	t->ops += 2 * LARSON_ROUND;
+
+	/* Thread 0 decides when the run is over, for everybody */
+	if (t->id == 0 && now() >= end)
+	    run->stop = 1;
+	pthread_barrier_wait(&larson_round);
+	if (run->stop)
+	    break;
+	pthread_barrier_wait(&larson_round);  /* everybody saw stop */
+    }
+    return NULL;
+}
+
+
+/****************************************************************
+ * threadtest
+ ****************************************************************/
+
+#define THREADTEST_OBJECTS 10000  /* objects in a batch */
+#define THREADTEST_SIZE        8  /* bytes per object */
+
+static void *threadtest(void *arg)
+{
+    thread_t *t = (thread_t *)arg;
+    run_t *run = t->run;
+    allocator_t *a = run->alloc;
+    int n = THREADTEST_OBJECTS / run->threads, i;
+    long it;
+    char **obj;
+
+    if ((obj = (char **)malloc(n * sizeof(char *))) == NULL)
+	unix_error("malloc failed in threadtest");
+    pthread_barrier_wait(&run->start);
+    for (it = 0; it < run->iterations; it++) {
+	for (i = 0; i < n; i++) {
+	    obj[i] = bench_malloc(a, THREADTEST_SIZE);
+	    obj[i][0] = (char)i;
+	}
+	for (i = 0; i < n; i++)
+	    a->free(obj[i]);
+    }
+    t->ops = 2L * n * run->iterations;
+    free(obj);
+    return NULL;
+}
+
+
+/****************************************************************
+ * xmalloc. Thread 2i produces for thread 2i+1 through a ring of
+ * batches; with an odd number of threads, the last one produces
+ * and consumes its own batches.
+ ****************************************************************/
+
+#define XM_BATCH  64   /* blocks in a batch */
+#define XM_RING   64   /* batches in flight per pair */
+#define XM_MIN     8   /* block sizes */
+#define XM_MAX   256
+
+typedef struct {
+    void *batch[XM_RING][XM_BATCH];
+    volatile unsigned long head, tail;  /* produced, consumed */
+    volatile int done;                  /* the producer stopped */
+} ring_t;
+
+static ring_t *xm_rings[MAX_THREADS / 2 + 1];
+
+static void xm_setup(run_t *run)
+{
+    int i;
+
+    for (i = 0; i < (run->threads + 1) / 2; i++)
+	if ((xm_rings[i] = (ring_t *)calloc(1, sizeof(ring_t))) == NULL)
+	    unix_error("calloc failed in xm_setup");
+}
+
+static void xm_teardown(run_t *run)
+{
+    int i;
+
+    for (i = 0; i < (run->threads + 1) / 2; i++)
+	free(xm_rings[i]);
+}
+
+static void xm_produce(thread_t *t, ring_t *ring, unsigned *seed)
+{
+    allocator_t *a = t->run->alloc;
+    void **batch;
+    int i;
+
+    while (ring->head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) == XM_RING)
+	sched_yield();
+    batch = ring->batch[ring->head % XM_RING];
+    for (i = 0; i < XM_BATCH; i++)
+	batch[i] = bench_malloc(a, XM_MIN + rnd(seed) % (XM_MAX - XM_MIN));
+    __atomic_store_n(&ring->head, ring->head + 1, __ATOMIC_RELEASE);
+    t->ops += XM_BATCH;
+}
+
+/* returns 0 if the ring is empty */
+static int xm_consume(thread_t *t, ring_t *ring)
+{
+    allocator_t *a = t->run->alloc;
+    void **batch;
+    int i;
+
+    if (__atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == ring->tail)
+	return 0;
+    batch = ring->batch[ring->tail % XM_RING];
+    for (i = 0; i < XM_BATCH; i++)
+	a->free(batch[i]);
+    __atomic_store_n(&ring->tail, ring->tail + 1, __ATOMIC_RELEASE);
+    t->ops += XM_BATCH;
+    return 1;
+}
+
+static void *xm(void *arg)
+{
+    thread_t *t = (thread_t *)arg;
+    run_t *run = t->run;
+    ring_t *ring = xm_rings[t->id / 2];
+    unsigned seed = 2 * t->id + 1;
+    int alone = (t->id == run->threads - 1) && (run->threads % 2 == 1);
+    double end;
+
+    pthread_barrier_wait(&run->start);
+    end = now() + run->duration;
+    if (alone) {
+	while (now() < end) {
+	    xm_produce(t, ring, &seed);
+	    xm_consume(t, ring);
+	}
+    } else if (t->id % 2 == 0) {
+	while (now() < end)
+	    xm_produce(t, ring, &seed);
+	__atomic_store_n(&ring->done, 1, __ATOMIC_RELEASE);
+    } else {
+	/* yield when the ring is empty, as the producer does when it is full */
+	while (!__atomic_load_n(&ring->done, __ATOMIC_ACQUIRE))
+	    if (!xm_consume(t, ring))
+		sched_yield();
+	while (xm_consume(t, ring))  /* what was produced last */
+	    ;
+    }
+    return NULL;
+}
+
+
+/****************************************************************
+ * cache-thrash and cache-scratch
+ ****************************************************************/
+
+#define CACHE_OBJ_SIZE   8   /* bytes per object */
+#define CACHE_WRITES  1000   /* writes to each byte of an object */
+
+static void *scratch_objs[MAX_THREADS];
+
+static void scratch_setup(run_t *run)
+{
+    int i;
+
+    for (i = 0; i < run->threads; i++)
+	scratch_objs[i] = bench_malloc(run->alloc, CACHE_OBJ_SIZE);
+}
+
+static void cache_loop(thread_t *t)
+{
+    allocator_t *a = t->run->alloc;
+    volatile char *obj;
+    long it;
+    int i, j;
+
+    for (it = 0; it < t->run->iterations; it++) {
+	obj = bench_malloc(a, CACHE_OBJ_SIZE);
+	for (i = 0; i < CACHE_WRITES; i++)
+	    for (j = 0; j < CACHE_OBJ_SIZE; j++)
+		obj[j]++;
+	a->free((void *)obj);
+    }
+    t->ops += 2 * t->run->iterations;
+}
+
+static void *cache_thrash(void *arg)
+{
+    thread_t *t = (thread_t *)arg;
+
+    pthread_barrier_wait(&t->run->start);
+    cache_loop(t);
+    return NULL;
+}
+
+static void *cache_scratch(void *arg)
+{
+    thread_t *t = (thread_t *)arg;
+
+    pthread_barrier_wait(&t->run->start);
+    t->run->alloc->free(scratch_objs[t->id]);
+    t->ops++;
+    cache_loop(t);
+    return NULL;
+}
+
+
+static bench_t benches[] = {
+    {"larson", larson, larson_setup, larson_teardown},
+    {"threadtest", threadtest, NULL, NULL},
+    {"xmalloc", xm, xm_setup, xm_teardown},
+    {"cache-thrash", cache_thrash, NULL, NULL},
+    {"cache-scratch", cache_scratch, scratch_setup, NULL},
+    {NULL, NULL, NULL, NULL}
+};
+
+/*
+ * run_bench - run benchmark b on the given number of threads; returns
+ *     the wall time, and the number of allocator calls in *ops
+ */
+static double run_bench(bench_t *b, allocator_t *a, int threads,
+			double duration, long iterations, long *ops)
+{
+    thread_t t[MAX_THREADS];
+    pthread_t tid[MAX_THREADS];
+    run_t run;
+    double start, secs;
+    int i;
+
+    /* A fresh mm heap for every run */
+    if (a->malloc == mm_locked_malloc) {
+	mem_reset_brk();
+	if (mm_init() < 0) {
+	    fprintf(stderr, "mm_init failed\n");
+	    exit(1);
+	}
+    }
+
+    memset(&run, 0, sizeof(run));
+    run.alloc = a;
+    run.threads = threads;
+    run.duration = duration;
+    run.iterations = iterations;
+    pthread_barrier_init(&run.start, NULL, threads + 1);
+    if (b->setup != NULL)
+	b->setup(&run);
+
+    memset(t, 0, sizeof(t));
+    for (i = 0; i < threads; i++) {
+	t[i].run = &run;
+	t[i].id = i;
+	if (pthread_create(&tid[i], NULL, b->body, &t[i]) != 0)
+	    unix_error("pthread_create failed in run_bench");
+    }
+    start = now();
+    pthread_barrier_wait(&run.start);
+    for (i = 0; i < threads; i++)
+	pthread_join(tid[i], NULL);
+    secs = now() - start;
+
+    if (b->teardown != NULL)
+	b->teardown(&run);
+    pthread_barrier_destroy(&run.start);
+    for (*ops = 0, i = 0; i < threads; i++)
+	*ops += t[i].ops;
+    return secs;
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "Usage: mm_bench [-hc] [-a <alloc>] [-b <bench>] [-n <threads>] "
+	    "[-d <secs>] [-i <iters>]\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-a <alloc>    Run only libc or mm.\n");
+    fprintf(stderr, "\t-b <bench>    Run only larson, threadtest, xmalloc,\n");
+    fprintf(stderr, "\t              cache-thrash or cache-scratch.\n");
+    fprintf(stderr, "\t-c            Print CSV.\n");
+    fprintf(stderr, "\t-d <secs>     Run the timed benchmarks for <secs> (default 1).\n");
+    fprintf(stderr, "\t-h            Print this message.\n");
+    fprintf(stderr, "\t-i <iters>    Iterations of the others (default 1000).\n");
+    fprintf(stderr, "\t-n <threads>  Run on 1, 2, 4, ... up to <threads> threads\n");
+    fprintf(stderr, "\t              (default: the number of CPUs).\n");
+}
+
+int main(int argc, char **argv)
+{
+    char *only_alloc = NULL, *only_bench = NULL;
+    int c, csv = 0, max_threads = (int)sysconf(_SC_NPROCESSORS_ONLN), threads;
+    double duration = 1.0, secs;
+    long iterations = 1000, ops;
+    allocator_t *a;
+    bench_t *b;
+
+    while ((c = getopt(argc, argv, "a:b:cd:hi:n:")) != EOF) {
+	switch (c) {
+	case 'a': /* One allocator */
+	    only_alloc = optarg;
+	    break;
+	case 'b': /* One benchmark */
+	    only_bench = optarg;
+	    break;
+	case 'c': /* CSV output */
+	    csv = 1;
+	    break;
+	case 'd': /* Duration of the timed benchmarks */
+	    duration = atof(optarg);
+	    break;
+	case 'i': /* Iterations of the others */
+	    iterations = atol(optarg);
+	    break;
+	case 'n': /* Most threads */
+	    max_threads = atoi(optarg);
+	    break;
+	case 'h':
+	    usage();
+	    exit(0);
+	default:
+	    usage();
+	    exit(1);
+	}
+    }
+    if (max_threads < 1 || max_threads > MAX_THREADS || duration <= 0 ||
+	iterations < 1 || optind != argc) {
+	usage();
+	exit(1);
+    }
+
+    mem_init();
+    if (csv)
+	printf("benchmark,allocator,threads,secs,ops,mops\n");
+    else
+	printf("benchmark      alloc  threads      secs         ops    Mops/s\n");
+
+    for (b = benches; b->name != NULL; b++) {
+	if (only_bench != NULL && strcmp(only_bench, b->name) != 0)
+	    continue;
+	for (a = allocators; a->name != NULL; a++) {
+	    if (only_alloc != NULL && strcmp(only_alloc, a->name) != 0)
+		continue;
+	    for (threads = 1; ; threads *= 2) {
+		if (threads > max_threads)
+		    threads = max_threads;
+		secs = run_bench(b, a, threads, duration, iterations, &ops);
+		printf(csv ? "%s,%s,%d,%.6f,%ld,%.3f\n" :
+		       "%-14s %-5s %8d %9.4f %11ld %9.3f\n",
+		       b->name, a->name, threads, secs, ops, ops / secs / 1e6);
+		fflush(stdout);
+		if (threads == max_threads)
+		    break;
+	    }
+	}
+    }
+    exit(0);
+}
@@ -0,0 +1,94 @@
+/*
+ * mm_conv.c - converts trace files between the text format and the
+ *     binary format that mdriver maps into memory (see trace.h):
+ *
+ *         make mm_conv
+ *         ./mm_conv big.rep big.bin     # text -> binary
+ *         ./mm_conv big.bin big.rep     # binary -> text
+ *         ./mm_conv -c big.bin          # check the header and checksum
+ *
+ *     The format of the input is detected from its magic number, and the
+ *     output is written in the other format (or in the one forced by -t
+ *     or -b). mdriver reads either format.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <inttypes.h>
+
+#include "trace.h"
+
+int verbose = 0; /* read by trace.c */
+
+static void usage(void)
+{
+    fprintf(stderr, "Usage: mm_conv [-tb] <in> <out>\n");
+    fprintf(stderr, "       mm_conv -c <in>\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-b         Write a binary trace.\n");
+    fprintf(stderr, "\t-c         Check <in> and print its header.\n");
+    fprintf(stderr, "\t-h         Print this message.\n");
+    fprintf(stderr, "\t-t         Write a text trace.\n");
+}
+
+int main(int argc, char **argv)
+{
+    int c, check = 0, binary = -1;
+    trace_t *trace;
+    FILE *out;
+
+    while ((c = getopt(argc, argv, "bcth")) != EOF) {
+	switch (c) {
+	case 'b': /* Force binary output */
+	    binary = 1;
+	    break;
+	case 't': /* Force text output */
+	    binary = 0;
+	    break;
+	case 'c': /* Only check the input */
+	    check = 1;
+	    break;
+	case 'h':
+	    usage();
+	    exit(0);
+	default:
+	    usage();
+	    exit(1);
+	}
+    }
+    if (argc - optind != (check ? 1 : 2)) {
+	usage();
+	exit(1);
+    }
+
+    /* read_trace checks the checksum of a binary trace */
+    trace = read_trace("", argv[optind]);
+
+    if (check) {
+	printf("%s: %s trace, %d ids, %d ops, %d threads, checksum %016" PRIx64 "\n",
+	       argv[optind], trace->map_len ? "binary" : "text",
+	       trace->num_ids, trace->num_ops, trace->num_threads,
+	       trace_checksum(trace->ops, trace->tids, trace->num_ops));
+	free_trace(trace);
+	exit(0);
+    }
+
+    if (binary < 0)
+	binary = (trace->map_len == 0);
+    if ((out = fopen(argv[optind + 1], "w")) == NULL) {
+	perror(argv[optind + 1]);
+	exit(1);
+    }
+    setvbuf(out, NULL, _IOFBF, 1 << 20);
+    if (binary)
+	write_trace_binary(out, trace);
+    else
+	write_trace_text(out, trace);
+    if (fclose(out) != 0) {
+	perror(argv[optind + 1]);
+	exit(1);
+    }
+    free_trace(trace);
+    exit(0);
+}
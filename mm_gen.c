@@ -0,0 +1,783 @@
+/*
+ * mm_gen.c - generates synthetic trace files for mdriver from a declarative
+ *     workload spec and a seed:
+ *
+ *         make mm_gen
+ *         ./mm_gen -p random -o random-x100.rep
+ *         ./mm_gen -f workload.spec -s 7 -o workload.rep
+ *         ./mdriver -V -f random-x100.rep
+ *
+ *     A spec is a list of lines ('#' starts a comment):
+ *
+ *         seed N           seed of the random number generator (-s overrides it)
+ *         balance 0|1      free every block at the end of the trace
+ *                          (-b overrides it)
+ *         repeat N         run the list of phases N times (-x scales N)
+ *         phase N [cycle]  N allocations, drawn from the classes that follow:
+ *                          at random by weight, or with "cycle" in a fixed
+ *                          interleaving by weight
+ *         class [weight=W] size=DIST [life=LIFE] [steps=N grow=DIST every=N]
+ *                          a kind of block. With steps, the block is
+ *                          reallocated N times, once every "every"
+ *                          allocations, growing by grow bytes each time.
+ *
+ *     Time is counted in allocations. A DIST is one of fixed:N,
+ *     uniform:LO:HI, powerlaw:LO:HI:ALPHA, bimodal:A:B:P (A with
+ *     probability P), exp:MEAN or choice:V/W,V/W,... A LIFE is a DIST
+ *     counted from the allocation, "phase" (freed when the phase ends) or
+ *     "end" (freed when the round of phases ends, the default). Blocks that
+ *     die at the same time are freed in allocation order. An unbalanced
+ *     trace frees nothing after its last allocation.
+ *
+ *     The trace is generated twice from the same seed: the first pass
+ *     counts the ids, ops and peak live bytes for the header, the second
+ *     writes the requests. Only the live blocks are kept in memory, so
+ *     traces of tens of millions of ops are cheap to make.
+ *
+ *     The built-in presets (-l lists them, -d prints one) have the shape of
+ *     each default trace at 100x its length: the same size mix, lifetimes
+ *     and request pattern, run for 100 rounds.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <math.h>
+
+#define MAXLINE     1024 /* max spec line */
+#define MAX_CHOICES   32 /* values in a choice distribution */
+#define MAX_CLASSES   16 /* classes in a phase */
+#define MAX_PHASES    16 /* phases in a spec */
+
+/* Distributions */
+enum {D_FIXED, D_UNIFORM, D_POWERLAW, D_BIMODAL, D_EXP, D_CHOICE,
+      D_PHASE, D_END};
+
+typedef struct {
+    int kind;
+    double a, b, c;              /* parameters, in the order of the spec */
+    int n;                       /* number of choices */
+    double val[MAX_CHOICES];     /* choice values ... */
+    double cum[MAX_CHOICES];     /* ... and their cumulative weights */
+} dist_t;
+
+/* A kind of block */
+typedef struct {
+    double weight;               /* relative share of the phase's allocations */
+    dist_t size;                 /* request size */
+    dist_t life;                 /* when the block is freed */
+    long steps;                  /* number of reallocs */
+    dist_t grow;                 /* bytes added by each realloc */
+    long every;                  /* allocations between reallocs */
+} class_t;
+
+typedef struct {
+    long allocs;                 /* allocations in the phase */
+    int cycle;                   /* interleave the classes instead of drawing */
+    int num_classes;
+    class_t classes[MAX_CLASSES];
+} phase_t;
+
+typedef struct {
+    unsigned long seed;
+    int balance;
+    long repeat;
+    int num_phases;
+    phase_t phases[MAX_PHASES];
+} spec_t;
+
+/* The next request due for a live block (the heap is ordered by time, id) */
+typedef struct {
+    uint64_t time;               /* when the request is due */
+    uint64_t death;              /* when the block is freed */
+    uint32_t id;
+    uint32_t size;
+    long steps;                  /* reallocs left */
+    const class_t *cls;
+} event_t;
+
+/* State of one generation pass */
+typedef struct {
+    FILE *out;                   /* NULL in the counting pass */
+    uint64_t ids;
+    uint64_t ops;
+    uint64_t live_bytes;
+    uint64_t peak_bytes;
+} gen_t;
+
+/* Built-in specs */
+typedef struct {
+    char *name;
+    char *text;
+} preset_t;
+
+static preset_t presets[] = {
+    {"amptjp",
+     "# amptjp-bal.rep: compiler, mostly short-lived 4072-byte blocks\n"
+     "seed 1\nbalance 1\nrepeat 100\n"
+     "phase 2847\n"
+     "class weight=70 size=choice:4072/83,72/13,120/1.5,24/1.2,5476/0.5,5420/0.2,10852/0.1 life=exp:27\n"
+     "class weight=30 size=choice:4072/48,160/28,9/8,456/5,10/4,40/1,11/1,72/1 life=uniform:200:2800\n"},
+    {"cccp",
+     "# cccp-bal.rep: compiler, mostly short-lived 4072-byte blocks\n"
+     "seed 2\nbalance 1\nrepeat 100\n"
+     "phase 2924\n"
+     "class weight=70 size=choice:4072/84,72/12,120/1.5,24/1.5,5476/0.5,21604/0.1 life=exp:30\n"
+     "class weight=30 size=choice:4072/50,160/27,9/8,456/5,10/4,24/2,40/1,11/1 life=uniform:200:2900\n"},
+    {"cp-decl",
+     "# cp-decl-bal.rep: compiler, mostly short-lived 4072-byte blocks\n"
+     "seed 3\nbalance 1\nrepeat 100\n"
+     "phase 3324\n"
+     "class weight=65 size=choice:4072/85,72/13,5476/0.6,10852/0.3,21604/0.1 life=exp:40\n"
+     "class weight=35 size=choice:4072/55,160/25,9/7,456/4,10/3,40/1,11/1,12/1 life=uniform:300:3300\n"},
+    {"expr",
+     "# expr-bal.rep: compiler, mostly short-lived 4072-byte blocks\n"
+     "seed 4\nbalance 1\nrepeat 100\n"
+     "phase 2690\n"
+     "class weight=60 size=choice:4072/83,72/14,160/1.7,5476/0.6,12992/0.3,10852/0.2,43108/0.1 life=exp:31\n"
+     "class weight=40 size=choice:4072/63,160/19,9/6,456/4,10/3,40/1,11/1,12/1 life=uniform:300:2700\n"},
+    {"coalescing",
+     "# coalescing-bal.rep: two 4095-byte blocks, then one 8190-byte block\n"
+     "seed 5\nbalance 1\nrepeat 240000\n"
+     "phase 2\n"
+     "class size=fixed:4095 life=phase\n"
+     "phase 1\n"
+     "class size=fixed:8190 life=phase\n"},
+    {"random",
+     "# random-bal.rep: uniform sizes, exponential lifetimes\n"
+     "seed 6\nbalance 1\nrepeat 100\n"
+     "phase 2400\n"
+     "class size=uniform:20:32755 life=exp:600\n"},
+    {"random2",
+     "# random2-bal.rep: uniform sizes, exponential lifetimes\n"
+     "seed 7\nbalance 1\nrepeat 100\n"
+     "phase 2400\n"
+     "class size=uniform:39:32755 life=exp:600\n"},
+    {"binary",
+     "# binary-bal.rep: 64/448 pairs, the 448s are freed, then 512s\n"
+     "seed 8\nbalance 1\nrepeat 100\n"
+     "phase 4000 cycle\n"
+     "class size=fixed:64\n"
+     "class size=fixed:448 life=phase\n"
+     "phase 2000\n"
+     "class size=fixed:512\n"},
+    {"binary2",
+     "# binary2-bal.rep: 16/112 pairs, the 112s are freed, then 128s\n"
+     "seed 9\nbalance 1\nrepeat 100\n"
+     "phase 8000 cycle\n"
+     "class size=fixed:16\n"
+     "class size=fixed:112 life=phase\n"
+     "phase 4000\n"
+     "class size=fixed:128\n"},
+    {"realloc",
+     "# realloc-bal.rep: one block grows by 128 bytes while small blocks come and go\n"
+     "seed 10\nbalance 1\nrepeat 100\n"
+     "phase 1\n"
+     "class size=fixed:512 steps=4799 grow=fixed:128 every=1\n"
+     "phase 4800\n"
+     "class size=fixed:128 life=fixed:2\n"},
+    {"realloc2",
+     "# realloc2-bal.rep: one block grows by 5 bytes while small blocks come and go\n"
+     "seed 11\nbalance 1\nrepeat 100\n"
+     "phase 1\n"
+     "class size=fixed:4092 steps=4799 grow=fixed:5 every=1\n"
+     "phase 4800\n"
+     "class size=fixed:16 life=fixed:2\n"},
+    {NULL, NULL}
+};
+
+/* Global state */
+static spec_t spec;
+static uint64_t rng_state;
+static event_t *heap = NULL;   /* pending requests of the live blocks */
+static size_t heap_len = 0, heap_cap = 0;
+static int lineno = 0;         /* spec line being parsed */
+static char msg[MAXLINE];      /* for composing error messages */
+
+static void usage(void);
+static void app_error(char *msg);
+static void spec_error(char *msg, char *token);
+
+/*********************************
+ * Random numbers and distributions
+ *********************************/
+
+static void seed_rng(unsigned long seed)
+{
+    /* splitmix64, so that small seeds give unrelated streams */
+    uint64_t z = seed + 0x9E3779B97F4A7C15ULL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    rng_state = (z ^ (z >> 31)) | 1;
+}
+
+/* xorshift64* */
+static uint64_t next_rand(void)
+{
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 0x2545F4914F6CDD1DULL;
+}
+
+/* uniform in (0, 1] */
+static double next_unit(void)
+{
+    return ((next_rand() >> 11) + 1) * (1.0 / 9007199254740992.0);
+}
+
+static double sample(const dist_t *d)
+{
+    double u = next_unit();
+    int i;
+
+    switch (d->kind) {
+    case D_FIXED:
+	return d->a;
+    case D_UNIFORM:
+	return floor(d->a + (d->b - d->a + 1) * (1 - u));
+    case D_POWERLAW:
+	/* inverse CDF of a Pareto distribution truncated to [a, b] */
+	return floor(d->a * pow(1 - u * (1 - pow(d->a / d->b, d->c)), -1 / d->c));
+    case D_BIMODAL:
+	return (u <= d->c) ? d->a : d->b;
+    case D_EXP:
+	return floor(-d->a * log(u)) + 1;
+    case D_CHOICE:
+	u *= d->cum[d->n - 1];
+	for (i = 0; i < d->n - 1 && u > d->cum[i]; i++)
+	    ;
+	return d->val[i];
+    }
+    return 0;
+}
+
+static uint32_t clamp(double x, uint32_t lo)
+{
+    if (x < lo)
+	return lo;
+    if (x > INT_MAX)
+	return INT_MAX;
+    return (uint32_t)x;
+}
+
+/*****************
+ * Parsing a spec
+ *****************/
+
+static double parse_number(char *s, char *token)
+{
+    char *end;
+    double x = strtod(s, &end);
+
+    if (end == s || (*end != '\0' && *end != ':'))
+	spec_error("bad number in", token);
+    return x;
+}
+
+static void parse_dist(char *token, char *s, dist_t *d, int is_life)
+{
+    char *args = strchr(s, ':');
+    char *p, *q, *save;
+    double w;
+
+    memset(d, 0, sizeof(*d));
+    if (is_life && !strcmp(s, "phase")) {
+	d->kind = D_PHASE;
+	return;
+    }
+    if (is_life && !strcmp(s, "end")) {
+	d->kind = D_END;
+	return;
+    }
+    if (args == NULL)
+	spec_error("bad distribution in", token);
+    *args++ = '\0';
+
+    if (!strcmp(s, "choice")) {
+	d->kind = D_CHOICE;
+	for (p = strtok_r(args, ",", &save); p != NULL; p = strtok_r(NULL, ",", &save)) {
+	    if (d->n == MAX_CHOICES)
+		spec_error("too many choices in", token);
+	    w = 1;
+	    if ((q = strchr(p, '/')) != NULL) {
+		*q++ = '\0';
+		w = parse_number(q, token);
+	    }
+	    d->val[d->n] = parse_number(p, token);
+	    d->cum[d->n] = w + (d->n ? d->cum[d->n - 1] : 0);
+	    d->n++;
+	}
+	if (d->n == 0 || d->cum[d->n - 1] <= 0)
+	    spec_error("empty choice in", token);
+	return;
+    }
+
+    d->a = parse_number(args, token);
+    if ((p = strchr(args, ':')) != NULL) {
+	d->b = parse_number(++p, token);
+	if ((p = strchr(p, ':')) != NULL)
+	    d->c = parse_number(++p, token);
+    }
+    if (!strcmp(s, "fixed"))
+	d->kind = D_FIXED;
+    else if (!strcmp(s, "uniform") && d->b >= d->a)
+	d->kind = D_UNIFORM;
+    else if (!strcmp(s, "powerlaw") && d->a > 0 && d->b > d->a && d->c > 0)
+	d->kind = D_POWERLAW;
+    else if (!strcmp(s, "bimodal") && d->c >= 0 && d->c <= 1)
+	d->kind = D_BIMODAL;
+    else if (!strcmp(s, "exp") && d->a > 0)
+	d->kind = D_EXP;
+    else
+	spec_error("bad distribution in", token);
+}
+
+static void parse_class(phase_t *phase, char *rest)
+{
+    class_t *cls;
+    char *token, *value, *save, copy[MAXLINE];
+    int have_size = 0;
+
+    if (phase == NULL)
+	spec_error("class before the first phase:", "class");
+    if (phase->num_classes == MAX_CLASSES)
+	spec_error("too many classes in the phase:", "class");
+    cls = &phase->classes[phase->num_classes++];
+    cls->weight = 1;
+    cls->life.kind = D_END;
+    cls->every = 1;
+
+    for (token = strtok_r(rest, " \t", &save); token != NULL;
+	 token = strtok_r(NULL, " \t", &save)) {
+	strcpy(copy, token);
+	if ((value = strchr(token, '=')) == NULL)
+	    spec_error("expected key=value, got", copy);
+	*value++ = '\0';
+	if (!strcmp(token, "weight")) {
+	    cls->weight = parse_number(value, copy);
+	} else if (!strcmp(token, "size")) {
+	    parse_dist(copy, value, &cls->size, 0);
+	    have_size = 1;
+	} else if (!strcmp(token, "life")) {
+	    parse_dist(copy, value, &cls->life, 1);
+	} else if (!strcmp(token, "grow")) {
+	    parse_dist(copy, value, &cls->grow, 0);
+	} else if (!strcmp(token, "steps")) {
+	    cls->steps = (long)parse_number(value, copy);
+	} else if (!strcmp(token, "every")) {
+	    cls->every = (long)parse_number(value, copy);
+	} else {
+	    spec_error("unknown key", copy);
+	}
+    }
+    if (!have_size)
+	spec_error("class without a size:", "class");
+    if (cls->weight <= 0 || cls->steps < 0 || cls->every < 1)
+	spec_error("weight, steps or every out of range in", "class");
+}
+
+/*
+ * parse_spec - parse the text of a spec (the text is modified)
+ */
+static void parse_spec(char *text)
+{
+    phase_t *phase = NULL;
+    char *line, *next, *cmd, *rest, *comment;
+    int i;
+
+    memset(&spec, 0, sizeof(spec));
+    spec.balance = 1;
+    spec.repeat = 1;
+
+    for (line = text, lineno = 1; line != NULL; line = next, lineno++) {
+	if ((next = strchr(line, '\n')) != NULL)
+	    *next++ = '\0';
+	if ((comment = strchr(line, '#')) != NULL)
+	    *comment = '\0';
+	if (strlen(line) >= MAXLINE)
+	    spec_error("line too long:", "");
+	cmd = line + strspn(line, " \t\r");
+	if (*cmd == '\0')
+	    continue;
+	rest = cmd + strcspn(cmd, " \t\r");
+	if (*rest != '\0')
+	    *rest++ = '\0';
+	rest[strcspn(rest, "\r")] = '\0';
+
+	if (!strcmp(cmd, "seed")) {
+	    spec.seed = strtoul(rest, NULL, 0);
+	} else if (!strcmp(cmd, "balance")) {
+	    spec.balance = atoi(rest) != 0;
+	} else if (!strcmp(cmd, "repeat")) {
+	    if ((spec.repeat = atol(rest)) < 1)
+		spec_error("bad repeat count:", rest);
+	} else if (!strcmp(cmd, "phase")) {
+	    if (spec.num_phases == MAX_PHASES)
+		spec_error("too many phases:", cmd);
+	    phase = &spec.phases[spec.num_phases++];
+	    phase->allocs = strtol(rest, &rest, 10);
+	    if (phase->allocs < 1)
+		spec_error("bad allocation count in", "phase");
+	    rest += strspn(rest, " \t");
+	    if (!strcmp(rest, "cycle"))
+		phase->cycle = 1;
+	    else if (*rest != '\0')
+		spec_error("unexpected", rest);
+	} else if (!strcmp(cmd, "class")) {
+	    parse_class(phase, rest);
+	} else {
+	    spec_error("unknown command", cmd);
+	}
+    }
+
+    lineno = 0;
+    if (spec.num_phases == 0)
+	spec_error("the spec has no phases", "");
+    for (i = 0; i < spec.num_phases; i++)
+	if (spec.phases[i].num_classes == 0)
+	    spec_error("a phase has no classes", "");
+}
+
+static char *read_file(char *filename)
+{
+    FILE *fp;
+    char *text;
+    long len;
+
+    if ((fp = fopen(filename, "rb")) == NULL) {
+	sprintf(msg, "Could not open %.*s", MAXLINE - 32, filename);
+	app_error(msg);
+    }
+    fseek(fp, 0, SEEK_END);
+    len = ftell(fp);
+    rewind(fp);
+    if ((text = malloc(len + 1)) == NULL)
+	app_error("malloc failed in read_file");
+    if (fread(text, 1, len, fp) != (size_t)len)
+	app_error("fread failed in read_file");
+    text[len] = '\0';
+    fclose(fp);
+    return text;
+}
+
+/*****************************
+ * The queue of live blocks
+ *****************************/
+
+static int before(const event_t *x, const event_t *y)
+{
+    return (x->time < y->time) || (x->time == y->time && x->id < y->id);
+}
+
+static void heap_push(event_t *ev)
+{
+    size_t i;
+
+    if (heap_len == heap_cap) {
+	heap_cap = heap_cap ? 2 * heap_cap : 1024;
+	if ((heap = realloc(heap, heap_cap * sizeof(event_t))) == NULL)
+	    app_error("realloc failed in heap_push");
+    }
+    for (i = heap_len++; i > 0 && before(ev, &heap[(i - 1) / 2]); i = (i - 1) / 2)
+	heap[i] = heap[(i - 1) / 2];
+    heap[i] = *ev;
+}
+
+static event_t heap_pop(void)
+{
+    event_t top = heap[0], last = heap[--heap_len];
+    size_t i = 0, child;
+
+    while ((child = 2 * i + 1) < heap_len) {
+	if (child + 1 < heap_len && before(&heap[child + 1], &heap[child]))
+	    child++;
+	if (!before(&heap[child], &last))
+	    break;
+	heap[i] = heap[child];
+	i = child;
+    }
+    heap[i] = last;
+    return top;
+}
+
+/*****************
+ * Generation
+ *****************/
+
+static void emit(gen_t *g, char type, uint32_t id, uint32_t size)
+{
+    g->ops++;
+    if (g->out == NULL)
+	return;
+    if (type == 'f')
+	fprintf(g->out, "f %u\n", id);
+    else
+	fprintf(g->out, "%c %u %u\n", type, id, size);
+}
+
+/*
+ * run_events - issue the reallocs and frees that are due by time now
+ */
+static void run_events(gen_t *g, uint64_t now)
+{
+    event_t ev;
+    uint32_t new_size;
+
+    while (heap_len > 0 && heap[0].time <= now) {
+	ev = heap_pop();
+	if (ev.steps == 0) {
+	    emit(g, 'f', ev.id, 0);
+	    g->live_bytes -= ev.size;
+	    continue;
+	}
+	new_size = clamp((double)ev.size + sample(&ev.cls->grow), 1);
+	emit(g, 'r', ev.id, new_size);
+	g->live_bytes += new_size;
+	g->live_bytes -= ev.size;
+	if (g->live_bytes > g->peak_bytes)
+	    g->peak_bytes = g->live_bytes;
+	ev.size = new_size;
+	ev.time += ev.cls->every;
+	if (--ev.steps == 0 || ev.time >= ev.death) {
+	    ev.steps = 0;
+	    ev.time = ev.death;
+	}
+	heap_push(&ev);
+    }
+}
+
+static void alloc_block(gen_t *g, const class_t *cls, uint64_t now,
+			uint64_t phase_end, uint64_t round_end)
+{
+    event_t ev;
+
+    if (g->ids == INT_MAX)
+	app_error("too many ids for a trace file");
+    ev.id = (uint32_t)g->ids++;
+    ev.size = clamp(sample(&cls->size), 1);
+    ev.cls = cls;
+    if (cls->life.kind == D_PHASE)
+	ev.death = phase_end;
+    else if (cls->life.kind == D_END)
+	ev.death = round_end;
+    else
+	ev.death = now + clamp(sample(&cls->life), 1);
+
+    emit(g, 'a', ev.id, ev.size);
+    g->live_bytes += ev.size;
+    if (g->live_bytes > g->peak_bytes)
+	g->peak_bytes = g->live_bytes;
+
+    ev.steps = cls->steps;
+    ev.time = now + cls->every;
+    if (ev.steps == 0 || ev.time >= ev.death) {
+	ev.steps = 0;
+	ev.time = ev.death;
+    }
+    heap_push(&ev);
+}
+
+/*
+ * pick_class - the class of the next allocation. In a cycle phase, the
+ *     classes are interleaved as evenly as their weights allow (smooth
+ *     weighted round robin, with credit[] carried between calls).
+ */
+static const class_t *pick_class(const phase_t *phase, double *credit)
+{
+    double total = 0, u;
+    int i, best = 0;
+
+    for (i = 0; i < phase->num_classes; i++)
+	total += phase->classes[i].weight;
+
+    if (phase->cycle) {
+	for (i = 0; i < phase->num_classes; i++) {
+	    credit[i] += phase->classes[i].weight;
+	    if (credit[i] > credit[best])
+		best = i;
+	}
+	credit[best] -= total;
+	return &phase->classes[best];
+    }
+
+    u = next_unit() * total;
+    for (i = 0; i < phase->num_classes - 1; i++) {
+	if ((u -= phase->classes[i].weight) <= 0)
+	    break;
+    }
+    return &phase->classes[i];
+}
+
+/*
+ * generate - run the spec once, writing the requests to g->out (if any)
+ */
+static void generate(gen_t *g)
+{
+    uint64_t now = 0, round_end, phase_end;
+    double credit[MAX_CLASSES];
+    const phase_t *phase;
+    long round, k;
+    int p;
+
+    seed_rng(spec.seed);
+    heap_len = 0;
+    for (round = 0; round < spec.repeat; round++) {
+	round_end = now;
+	for (p = 0; p < spec.num_phases; p++)
+	    round_end += spec.phases[p].allocs;
+
+	for (p = 0; p < spec.num_phases; p++) {
+	    phase = &spec.phases[p];
+	    phase_end = now + phase->allocs;
+	    memset(credit, 0, sizeof(credit));
+	    for (k = 0; k < phase->allocs; k++, now++) {
+		run_events(g, now);
+		alloc_block(g, pick_class(phase, credit), now, phase_end, round_end);
+	    }
+	}
+    }
+    if (spec.balance)
+	run_events(g, UINT64_MAX);
+}
+
+/**************
+ * Main routine
+ **************/
+int main(int argc, char **argv)
+{
+    char *text = NULL, *preset = NULL, *outfile = NULL;
+    char *seed_arg = NULL;
+    int balance = -1, dump = 0, i, c;
+    double scale = 1;
+    gen_t g;
+    FILE *out = stdout;
+
+    while ((c = getopt(argc, argv, "f:p:s:x:b:o:dlh")) != EOF) {
+	switch (c) {
+	case 'f': /* Read the spec from a file */
+	    text = read_file(optarg);
+	    break;
+	case 'p': /* Use a built-in spec */
+	    preset = optarg;
+	    break;
+	case 's': /* Override the seed */
+	    seed_arg = optarg;
+	    break;
+	case 'x': /* Scale the number of rounds */
+	    if ((scale = atof(optarg)) <= 0)
+		app_error("the scale must be positive");
+	    break;
+	case 'b': /* Override balance */
+	    balance = atoi(optarg) != 0;
+	    break;
+	case 'o': /* Output file */
+	    outfile = optarg;
+	    break;
+	case 'd': /* Print the spec instead of the trace */
+	    dump = 1;
+	    break;
+	case 'l': /* List the presets */
+	    for (i = 0; presets[i].name != NULL; i++)  /* name and first line */
+		printf("%-12s %.*s\n", presets[i].name,
+		       (int)strcspn(presets[i].text + 2, "\n"), presets[i].text + 2);
+	    exit(0);
+	case 'h':
+	    usage();
+	    exit(0);
+	default:
+	    usage();
+	    exit(1);
+	}
+    }
+
+    if (preset != NULL) {
+	for (i = 0; presets[i].name != NULL; i++)
+	    if (!strcmp(presets[i].name, preset))
+		break;
+	if (presets[i].name == NULL)
+	    app_error("Unknown preset (mm_gen -l lists them)");
+	text = strdup(presets[i].text);
+    }
+    if (text == NULL) {
+	usage();
+	exit(1);
+    }
+    if (dump) {
+	fputs(text, stdout);
+	exit(0);
+    }
+
+    parse_spec(text);
+    if (seed_arg != NULL)
+	spec.seed = strtoul(seed_arg, NULL, 0);
+    if (balance >= 0)
+	spec.balance = balance;
+    spec.repeat = (long)(spec.repeat * scale + 0.5);
+    if (spec.repeat < 1)
+	spec.repeat = 1;
+
+    /* First pass: count */
+    memset(&g, 0, sizeof(g));
+    generate(&g);
+    if (g.ops > INT_MAX)
+	app_error("too many ops for a trace file");
+
+    /* Second pass: write */
+    if (outfile != NULL && (out = fopen(outfile, "w")) == NULL)
+	app_error("Could not open the output file");
+    setvbuf(out, NULL, _IOFBF, 1 << 20);
+    fprintf(out, "%u\n%u\n%u\n1\n",
+	    (unsigned)(g.peak_bytes > INT_MAX ? INT_MAX : g.peak_bytes),
+	    (unsigned)g.ids, (unsigned)g.ops);
+    memset(&g, 0, sizeof(g));
+    g.out = out;
+    generate(&g);
+    if (fclose(out) != 0)
+	app_error("Could not write the trace");
+
+    free(heap);
+    free(text);
+    exit(0);
+}
+
+/*
+ * usage - Explain the command line arguments
+ */
+static void usage(void)
+{
+    fprintf(stderr, "Usage: mm_gen [-dlh] [-f <spec> | -p <preset>] [-s <seed>] [-x <scale>] [-b 0|1] [-o <file>]\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-b 0|1     Make a balanced (1) or unbalanced (0) trace.\n");
+    fprintf(stderr, "\t-d         Print the spec instead of the trace.\n");
+    fprintf(stderr, "\t-f <spec>  Read the workload spec from <spec>.\n");
+    fprintf(stderr, "\t-h         Print this message.\n");
+    fprintf(stderr, "\t-l         List the built-in presets.\n");
+    fprintf(stderr, "\t-o <file>  Write the trace to <file> (default stdout).\n");
+    fprintf(stderr, "\t-p <name>  Use a built-in preset.\n");
+    fprintf(stderr, "\t-s <seed>  Override the seed of the spec.\n");
+    fprintf(stderr, "\t-x <scale> Multiply the number of rounds by <scale>.\n");
+}
+
+/*
+ * app_error - Report an arbitrary application error
+ */
+static void app_error(char *msg)
+{
+    fprintf(stderr, "mm_gen: %s\n", msg);
+    exit(1);
+}
+
+/*
+ * spec_error - Report an error in the spec being parsed
+ */
+static void spec_error(char *msg, char *token)
+{
+    if (lineno > 0)
+	fprintf(stderr, "mm_gen: line %d: %s %s\n", lineno, msg, token);
+    else
+	fprintf(stderr, "mm_gen: %s %s\n", msg, token);
+    exit(1);
+}
@@ -0,0 +1,286 @@
+/*
+ * mm_mt.c - replays multithreaded traces (see trace.h) on real threads,
+ *     against the process's malloc, and reports how the throughput
+ *     scales with the number of threads:
+ *
+ *         make mm_mt libmm.so
+ *         ./mm_mt -n 8 server.rep                         # glibc malloc
+ *         LD_PRELOAD=./libmm.so ./mm_mt -n 8 server.rep   # mm.c
+ *
+ *     Each thread of the trace runs its ops on its own pthread. To go
+ *     from 1 to N threads, k = 1, 2, ... copies of the trace are run at
+ *     once, each copy with its own blocks and events, until there would
+ *     be more than N threads. Scaling efficiency is the throughput of k
+ *     copies over k times the throughput of one.
+ *
+ *     Ops on the same block from different threads must be ordered by
+ *     barriers in the trace; the replay does not order them otherwise.
+ *     A single-threaded trace is a one-thread trace, so the default
+ *     traces measure how k independent threads scale.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+
+#include "trace.h"
+
+int verbose = 0; /* read by trace.c */
+
+#define RUNS 3     /* each configuration is timed RUNS times; the best counts */
+
+/* The ops of one thread of the trace */
+typedef struct {
+    int *ops;        /* indices into trace->ops */
+    int num_ops;
+} thread_ops_t;
+
+/* A copy of the trace being replayed: its own blocks and events */
+typedef struct {
+    char **blocks;   /* block of each id */
+    int *events;     /* is each event set? */
+} copy_t;
+
+/* One replay thread */
+typedef struct {
+    trace_t *trace;
+    thread_ops_t *tops;  /* the ops it replays ... */
+    copy_t *copy;        /* ... in this copy of the trace */
+    pthread_barrier_t *start;
+    struct timespec t0, t1;  /* when it started and finished */
+} worker_t;
+
+static void usage(void)
+{
+    fprintf(stderr, "Usage: mm_mt [-hv] [-n <threads>] [-r <runs>] <trace>...\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-h         Print this message.\n");
+    fprintf(stderr, "\t-n <n>     Go up to <n> threads (default: the number of CPUs).\n");
+    fprintf(stderr, "\t-r <runs>  Keep the best of <runs> runs (default %d).\n", RUNS);
+    fprintf(stderr, "\t-v         Print the throughput of every thread.\n");
+}
+
+static void unix_error(char *msg)
+{
+    fprintf(stderr, "%s: %s\n", msg, strerror(errno));
+    exit(1);
+}
+
+static double elapsed(struct timespec *a, struct timespec *b)
+{
+    return (b->tv_sec - a->tv_sec) + (b->tv_nsec - a->tv_nsec) / 1e9;
+}
+
+/*
+ * replay - the body of a replay thread
+ */
+static void *replay(void *arg)
+{
+    worker_t *w = (worker_t *)arg;
+    traceop_t *ops = w->trace->ops, *op;
+    char **blocks = w->copy->blocks;
+    int *events = w->copy->events;
+    int *p = w->tops->ops, *end = p + w->tops->num_ops;
+
+    pthread_barrier_wait(w->start);
+    clock_gettime(CLOCK_MONOTONIC, &w->t0);
+    for (; p < end; p++) {
+	op = &ops[*p];
+	switch (op->type) {
+	case ALLOC:
+	    if ((blocks[op->index] = malloc(op->size)) == NULL)
+		unix_error("malloc failed in replay");
+	    break;
+	case REALLOC:
+	    if ((blocks[op->index] = realloc(blocks[op->index], op->size)) == NULL)
+		unix_error("realloc failed in replay");
+	    break;
+	case FREE:
+	    free(blocks[op->index]);
+	    blocks[op->index] = NULL;
+	    break;
+	case SIGNAL:
+	    __atomic_store_n(&events[op->index], 1, __ATOMIC_RELEASE);
+	    break;
+	case WAIT:
+	    while (!__atomic_load_n(&events[op->index], __ATOMIC_ACQUIRE))
+		sched_yield();
+	    break;
+	}
+    }
+    clock_gettime(CLOCK_MONOTONIC, &w->t1);
+    return NULL;
+}
+
+/*
+ * split_trace - sort the ops of the trace by thread; returns the
+ *     number of events its barriers use
+ */
+static int split_trace(trace_t *trace, thread_ops_t *tops)
+{
+    int i, t, num_events = 0;
+
+    for (i = 0; i < trace->num_ops; i++) {
+	tops[trace->tids ? trace->tids[i] : 0].num_ops++;
+	if ((trace->ops[i].type == SIGNAL || trace->ops[i].type == WAIT) &&
+	    trace->ops[i].index >= num_events)
+	    num_events = trace->ops[i].index + 1;
+    }
+    for (t = 0; t < trace->num_threads; t++) {
+	if ((tops[t].ops = (int *)malloc((tops[t].num_ops + 1) * sizeof(int))) == NULL)
+	    unix_error("malloc failed in split_trace");
+	tops[t].num_ops = 0;
+    }
+    for (i = 0; i < trace->num_ops; i++) {
+	t = trace->tids ? trace->tids[i] : 0;
+	tops[t].ops[tops[t].num_ops++] = i;
+    }
+    return num_events;
+}
+
+/*
+ * run_copies - replay k copies of the trace at once; returns the wall
+ *     time, and the time of each thread in secs[]
+ */
+static double run_copies(trace_t *trace, thread_ops_t *tops, int num_events,
+			 int k, double *secs)
+{
+    int T = trace->num_threads, n = k * T, i, c;
+    copy_t *copies;
+    worker_t *w;
+    pthread_t *tid;
+    pthread_barrier_t start;
+    struct timespec t0, t1;
+
+    if ((copies = (copy_t *)calloc(k, sizeof(copy_t))) == NULL ||
+	(w = (worker_t *)calloc(n, sizeof(worker_t))) == NULL ||
+	(tid = (pthread_t *)calloc(n, sizeof(pthread_t))) == NULL)
+	unix_error("calloc failed in run_copies");
+    for (c = 0; c < k; c++)
+	if ((copies[c].blocks = (char **)calloc(trace->num_ids + 1, sizeof(char *))) == NULL ||
+	    (copies[c].events = (int *)calloc(num_events + 1, sizeof(int))) == NULL)
+	    unix_error("calloc failed in run_copies");
+
+    pthread_barrier_init(&start, NULL, n);
+    for (i = 0; i < n; i++) {
+	w[i].trace = trace;
+	w[i].tops = &tops[i % T];
+	w[i].copy = &copies[i / T];
+	w[i].start = &start;
+	if (pthread_create(&tid[i], NULL, replay, &w[i]) != 0)
+	    unix_error("pthread_create failed in run_copies");
+    }
+    for (i = 0; i < n; i++)
+	pthread_join(tid[i], NULL);
+    pthread_barrier_destroy(&start);
+
+    /* The wall time is from the first start to the last finish */
+    t0 = w[0].t0;
+    t1 = w[0].t1;
+    for (i = 0; i < n; i++) {
+	secs[i] = elapsed(&w[i].t0, &w[i].t1);
+	if (elapsed(&w[i].t0, &t0) > 0)
+	    t0 = w[i].t0;
+	if (elapsed(&t1, &w[i].t1) > 0)
+	    t1 = w[i].t1;
+    }
+
+    /* Free what the trace left allocated, outside the timed part */
+    for (c = 0; c < k; c++) {
+	for (i = 0; i < trace->num_ids; i++)
+	    free(copies[c].blocks[i]);
+	free(copies[c].blocks);
+	free(copies[c].events);
+    }
+    free(copies);
+    free(w);
+    free(tid);
+    return elapsed(&t0, &t1);
+}
+
+/*
+ * eval_trace - report the scaling of one trace from 1 to max_threads
+ */
+static void eval_trace(char *filename, int max_threads, int runs)
+{
+    trace_t *trace = read_trace("", filename);
+    int T = trace->num_threads, k, i, r, num_events;
+    thread_ops_t *tops;
+    double secs, best, kops, base = 0;
+    double *tsecs, *best_tsecs;
+
+    if ((tops = (thread_ops_t *)calloc(T, sizeof(thread_ops_t))) == NULL ||
+	(tsecs = (double *)calloc(max_threads + T, sizeof(double))) == NULL ||
+	(best_tsecs = (double *)calloc(max_threads + T, sizeof(double))) == NULL)
+	unix_error("calloc failed in eval_trace");
+    num_events = split_trace(trace, tops);
+
+    printf("%s: %d thread%s, %d ops\n", filename, T, (T == 1) ? "" : "s",
+	   trace->num_ops);
+    printf("copies threads      secs       Kops  Kops/thread  efficiency\n");
+    for (k = 1; k == 1 || k * T <= max_threads; k++) {
+	best = 0;
+	for (r = 0; r < runs; r++) {
+	    secs = run_copies(trace, tops, num_events, k, tsecs);
+	    if (r == 0 || secs < best) {
+		best = secs;
+		memcpy(best_tsecs, tsecs, k * T * sizeof(double));
+	    }
+	}
+	kops = (double)k * trace->num_ops / best / 1000.0;
+	if (k == 1)
+	    base = kops;
+	printf("%6d %7d %9.6f %10.0f %12.0f %10.1f%%\n", k, k * T, best, kops,
+	       kops / (k * T), 100.0 * kops / (k * base));
+	if (verbose)
+	    for (i = 0; i < k * T; i++)
+		printf("    thread %d (copy %d): %d ops, %.6f secs, %.0f Kops\n",
+		       i % T, i / T, tops[i % T].num_ops, best_tsecs[i],
+		       tops[i % T].num_ops / best_tsecs[i] / 1000.0);
+    }
+    printf("\n");
+
+    for (i = 0; i < T; i++)
+	free(tops[i].ops);
+    free(tops);
+    free(tsecs);
+    free(best_tsecs);
+    free_trace(trace);
+}
+
+int main(int argc, char **argv)
+{
+    int c, max_threads = (int)sysconf(_SC_NPROCESSORS_ONLN), runs = RUNS;
+
+    while ((c = getopt(argc, argv, "n:r:hv")) != EOF) {
+	switch (c) {
+	case 'n': /* Most threads to run */
+	    max_threads = atoi(optarg);
+	    break;
+	case 'r': /* Runs per configuration */
+	    runs = atoi(optarg);
+	    break;
+	case 'v': /* Print every thread */
+	    verbose = 1;
+	    break;
+	case 'h':
+	    usage();
+	    exit(0);
+	default:
+	    usage();
+	    exit(1);
+	}
+    }
+    if (optind == argc || max_threads < 1 || runs < 1) {
+	usage();
+	exit(1);
+    }
+
+    for (; optind < argc; optind++)
+	eval_trace(argv[optind], max_threads, runs);
+    exit(0);
+}
@@ -0,0 +1,487 @@
+/*
+ * mm_record.c - an LD_PRELOAD library that records the malloc/free/realloc/
+ *     calloc calls of a real program and writes them as a trace file in
+ *     the format read by mdriver:
+ *
+ *         make librecord.so
+ *         MM_RECORD_FILE=prog.rep LD_PRELOAD=./librecord.so <program>
+ *         ./mdriver -f prog.rep
+ *
+ *     The calls are forwarded to glibc's allocator. While the program
+ *     runs, each thread appends compact records (a global sequence number,
+ *     the pointers and the size) to its own buffer, which is flushed to a
+ *     raw file when it fills up. When the program exits the raw records are
+ *     sorted by sequence number, the pointers are mapped to dense block ids,
+ *     and the trace is written. Frees of pointers that were allocated before
+ *     recording started are dropped.
+ *
+ *     A "%p" in MM_RECORD_FILE is replaced with the process id, so programs
+ *     that exec other programs get one trace per process. Forked children
+ *     that don't exec are not recorded.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* glibc's allocator */
+extern void *__libc_malloc(size_t size);
+extern void __libc_free(void *ptr);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_memalign(size_t alignment, size_t size);
+
+#define BUF_RECORDS 4096   /* records per thread buffer */
+#define MAX_THREADS 1024   /* live threads whose buffers are flushed at exit */
+
+/* One raw record (what each allocator call costs while recording) */
+typedef struct {
+    uint64_t seq;          /* global order of the call */
+    uintptr_t ptr;         /* block returned (ALLOC, REALLOC) or given up (FREE, MOVE) */
+    uint64_t move;         /* REALLOC: seq of the MOVE record of the old block */
+    uint32_t size;         /* requested size */
+    uint32_t type;         /* REC_ALLOC, REC_FREE, REC_MOVE or REC_REALLOC */
+} record_t;
+
+/*
+ * A realloc is two records: MOVE gives up the old block, with a seq taken
+ * before the real call, and REALLOC returns the new one, with a seq taken
+ * after it.
+ */
+enum {REC_ALLOC, REC_FREE, REC_MOVE, REC_REALLOC};
+
+typedef struct {
+    int count;                    /* records in the buffer */
+    int slot;                     /* index in buffers[], -1 if not there */
+    record_t recs[BUF_RECORDS];
+} recbuf_t;
+
+/* Global state */
+static uint64_t next_seq = 0;             /* global sequence counter */
+static int raw_fd = -1;                   /* raw record file */
+static char raw_path[4096];               /* ... and its name */
+static char out_path[4096];               /* trace file to write at exit */
+static int recording = 0;                 /* set while the program runs */
+static pthread_mutex_t flush_lock = PTHREAD_MUTEX_INITIALIZER;
+static recbuf_t *buffers[MAX_THREADS];    /* the buffers of live threads */
+static int num_buffers = 0;
+static pthread_key_t buf_key;             /* flushes a buffer at thread exit */
+
+static __thread recbuf_t *my_buf __attribute__((tls_model("initial-exec")));
+static __thread int in_hook __attribute__((tls_model("initial-exec")));
+
+/*
+ * warn - print a message on stderr (which isn't buffered, so this
+ *     doesn't allocate, but the hooks are off just in case)
+ */
+static void warn(char *msg)
+{
+    int saved = in_hook;
+
+    in_hook = 1;
+    fprintf(stderr, "mm_record: %s\n", msg);
+    in_hook = saved;
+}
+
+/*
+ * flush_locked - append a thread buffer to the raw file; the caller
+ *     holds flush_lock
+ */
+static void flush_locked(recbuf_t *buf)
+{
+    char *p = (char *)buf->recs;
+    size_t left = buf->count * sizeof(record_t);
+    ssize_t n;
+
+    while (left > 0 && (n = write(raw_fd, p, left)) > 0) {
+	p += n;
+	left -= n;
+    }
+    buf->count = 0;
+}
+
+static void flush(recbuf_t *buf)
+{
+    pthread_mutex_lock(&flush_lock);
+    flush_locked(buf);
+    pthread_mutex_unlock(&flush_lock);
+}
+
+/*
+ * flush_at_thread_exit - flush an exiting thread's buffer, and give it
+ *     and its slot back (a destructor that allocates after this gets a
+ *     new buffer, which is flushed at exit)
+ */
+static void flush_at_thread_exit(void *arg)
+{
+    recbuf_t *buf = (recbuf_t *)arg;
+
+    pthread_mutex_lock(&flush_lock);
+    flush_locked(buf);
+    if (buf->slot >= 0) {
+	buffers[buf->slot] = buffers[--num_buffers];
+	buffers[buf->slot]->slot = buf->slot;
+    }
+    pthread_mutex_unlock(&flush_lock);
+    my_buf = NULL;
+    munmap(buf, sizeof(recbuf_t));
+}
+
+/*
+ * get_buf - the calling thread's buffer (mmap'ed, so recording never
+ *     allocates through malloc). If it can't be mapped, recording stops:
+ *     a trace with calls missing from the middle would be wrong.
+ */
+static recbuf_t *get_buf(void)
+{
+    static int warned = 0;
+    recbuf_t *buf;
+
+    if (my_buf != NULL)
+	return my_buf;
+    buf = mmap(NULL, sizeof(recbuf_t), PROT_READ | PROT_WRITE,
+	       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (buf == MAP_FAILED) {
+	recording = 0;
+	warn("could not map a thread buffer, so recording stopped here");
+	return NULL;
+    }
+    buf->count = 0;
+    buf->slot = -1;
+    pthread_mutex_lock(&flush_lock);
+    if (num_buffers < MAX_THREADS) {
+	buf->slot = num_buffers;
+	buffers[num_buffers++] = buf;
+    } else if (!warned) {
+	warned = 1;
+	warn("too many threads at once; the extra ones write every record "
+	     "straight to the raw file");
+    }
+    pthread_mutex_unlock(&flush_lock);
+    pthread_setspecific(buf_key, buf);
+    my_buf = buf;
+    return buf;
+}
+
+/*
+ * record - append one call to the calling thread's buffer (a buffer that
+ *     isn't in buffers[] wouldn't be flushed at exit, so it is flushed
+ *     after every record)
+ */
+static void record(int type, void *ptr, uint64_t move, size_t size, uint64_t seq)
+{
+    recbuf_t *buf;
+    record_t *r;
+
+    if ((buf = get_buf()) == NULL)
+	return;
+    r = &buf->recs[buf->count++];
+    r->seq = seq;
+    r->ptr = (uintptr_t)ptr;
+    r->move = move;
+    r->size = (size > UINT32_MAX) ? UINT32_MAX : (uint32_t)size;
+    r->type = type;
+    if (buf->count == BUF_RECORDS || buf->slot < 0)
+	flush(buf);
+}
+
+#define TAKE_SEQ() __atomic_fetch_add(&next_seq, 1, __ATOMIC_RELAXED)
+
+/*
+ * The hooks. A block is only reported as allocated after the real call
+ * returns, and as freed before the real call, so a block that is freed by
+ * one thread and handed out again to another is always ordered correctly.
+ * realloc does both: it takes the seq of the old block before the call,
+ * and records it once the call has succeeded.
+ */
+void *malloc(size_t size)
+{
+    void *p = __libc_malloc(size);
+    if (recording && !in_hook && p != NULL)
+	record(REC_ALLOC, p, 0, size, TAKE_SEQ());
+    return p;
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+    void *p = __libc_calloc(nmemb, size);
+    if (recording && !in_hook && p != NULL)
+	record(REC_ALLOC, p, 0, nmemb * size, TAKE_SEQ());
+    return p;
+}
+
+void free(void *ptr)
+{
+    if (recording && !in_hook && ptr != NULL)
+	record(REC_FREE, ptr, 0, 0, TAKE_SEQ());
+    __libc_free(ptr);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    void *p;
+    int rec = recording && !in_hook;
+    uint64_t move = 0;
+
+    if (ptr == NULL)
+	return malloc(size);
+    if (size == 0) {
+	free(ptr);
+	return NULL;
+    }
+    if (rec)
+	move = TAKE_SEQ();
+    p = __libc_realloc(ptr, size);
+    if (rec && p != NULL) {
+	record(REC_MOVE, ptr, 0, 0, move);
+	record(REC_REALLOC, p, move, size, TAKE_SEQ());
+    }
+    return p;
+}
+
+void *memalign(size_t alignment, size_t size)
+{
+    void *p = __libc_memalign(alignment, size);
+    if (recording && !in_hook && p != NULL)
+	record(REC_ALLOC, p, 0, size, TAKE_SEQ());
+    return p;
+}
+
+int posix_memalign(void **memptr, size_t alignment, size_t size)
+{
+    void *p;
+
+    if (alignment % sizeof(void *) != 0 || (alignment & (alignment - 1)))
+	return EINVAL;
+    if ((p = memalign(alignment, size)) == NULL)
+	return ENOMEM;
+    *memptr = p;
+    return 0;
+}
+
+void *aligned_alloc(size_t alignment, size_t size)
+{
+    return memalign(alignment, size);
+}
+
+/*****************************************************************
+ * Writing the trace: sort the raw records and map pointers to ids
+ ****************************************************************/
+
+/* Open addressing map from pointers to block ids */
+typedef struct {
+    uintptr_t ptr;   /* 0 if the slot is empty */
+    int id;
+} idslot_t;
+
+static idslot_t *idmap;
+static size_t idmap_mask;
+
+static size_t id_slot(uintptr_t ptr)
+{
+    size_t i = (size_t)((ptr >> 4) * 0x9e3779b97f4a7c15ull) & idmap_mask;
+    while (idmap[i].ptr != 0 && idmap[i].ptr != ptr)
+	i = (i + 1) & idmap_mask;
+    return i;
+}
+
+static void id_remove(size_t hole)
+{
+    size_t i, home;
+
+    idmap[hole].ptr = 0;
+    for (i = (hole + 1) & idmap_mask; idmap[i].ptr != 0;
+	 i = (i + 1) & idmap_mask) {
+	home = id_slot(idmap[i].ptr);
+	if (home != i) {
+	    idmap[home] = idmap[i];
+	    idmap[i].ptr = 0;
+	}
+    }
+}
+
+static int cmp_seq(const void *a, const void *b)
+{
+    uint64_t x = ((const record_t *)a)->seq, y = ((const record_t *)b)->seq;
+    return (x > y) - (x < y);
+}
+
+/*
+ * find_seq - the index of the record with sequence number seq in the
+ *     sorted records, or -1
+ */
+static long find_seq(record_t *recs, size_t n, uint64_t seq)
+{
+    size_t lo = 0, hi = n, mid;
+
+    while (lo < hi) {
+	mid = lo + (hi - lo) / 2;
+	if (recs[mid].seq < seq)
+	    lo = mid + 1;
+	else
+	    hi = mid;
+    }
+    return (lo < n && recs[lo].seq == seq) ? (long)lo : -1;
+}
+
+/*
+ * write_trace - turn the raw records into a trace file
+ */
+static void write_trace(void)
+{
+    struct stat st;
+    record_t *recs;
+    size_t n, i, slot;
+    long m;
+    int num_ids = 0, num_ops = 0, id = 0;
+    long live = 0, peak = 0;
+    long *sizes;     /* current size of each id */
+    FILE *out;
+    char *ops;       /* 'a', 'f' or 'r' for each record, 0 if dropped */
+    int *ids;
+
+    if (fstat(raw_fd, &st) < 0 || st.st_size == 0)
+	return;
+    n = st.st_size / sizeof(record_t);
+    recs = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+		raw_fd, 0);
+    if (recs == MAP_FAILED)
+	return;
+    qsort(recs, n, sizeof(record_t), cmp_seq);
+
+    for (idmap_mask = 1; idmap_mask < 2 * n; idmap_mask <<= 1)
+	;
+    idmap = calloc(idmap_mask, sizeof(idslot_t));
+    idmap_mask--;
+    ops = calloc(n, 1);
+    ids = calloc(n, sizeof(int));
+    sizes = calloc(n, sizeof(long));
+    if (!idmap || !ops || !ids || !sizes)
+	return;
+
+    /* Assign dense ids in allocation order */
+    for (i = 0; i < n; i++) {
+	record_t *r = &recs[i];
+	switch (r->type) {
+	case REC_ALLOC:
+	    slot = id_slot(r->ptr);   /* a stale entry is simply replaced */
+	    idmap[slot].ptr = r->ptr;
+	    idmap[slot].id = id = num_ids++;
+	    ops[i] = 'a';
+	    sizes[id] = (r->size == 0) ? 1 : r->size;
+	    live += sizes[id];
+	    break;
+	case REC_FREE:
+	    slot = id_slot(r->ptr);
+	    if (idmap[slot].ptr == 0)
+		continue;          /* allocated before recording started */
+	    id = idmap[slot].id;
+	    id_remove(slot);
+	    ops[i] = 'f';
+	    live -= sizes[id];
+	    break;
+	case REC_MOVE:
+	    /* the REALLOC record that follows takes over the id */
+	    slot = id_slot(r->ptr);
+	    ids[i] = -1;
+	    if (idmap[slot].ptr != 0) {
+		ids[i] = idmap[slot].id;
+		id_remove(slot);
+	    }
+	    continue;
+	case REC_REALLOC:
+	    m = find_seq(recs, n, r->move);
+	    if (m < 0 || ids[m] < 0) {   /* unknown block, treat as alloc */
+		slot = id_slot(r->ptr);
+		idmap[slot].ptr = r->ptr;
+		idmap[slot].id = id = num_ids++;
+		ops[i] = 'a';
+		sizes[id] = r->size;
+		live += sizes[id];
+		break;
+	    }
+	    id = ids[m];
+	    slot = id_slot(r->ptr);
+	    idmap[slot].ptr = r->ptr;
+	    idmap[slot].id = id;
+	    ops[i] = 'r';
+	    live += (long)r->size - sizes[id];
+	    sizes[id] = r->size;
+	    break;
+	}
+	ids[i] = id;
+	num_ops++;
+	peak = (live > peak) ? live : peak;
+    }
+
+    if ((out = fopen(out_path, "w")) == NULL) {
+	fprintf(stderr, "mm_record: could not open %s\n", out_path);
+	return;
+    }
+    fprintf(out, "%ld\n%d\n%d\n%d\n", peak, num_ids, num_ops, 1);
+    for (i = 0; i < n; i++) {
+	if (ops[i] == 'f')
+	    fprintf(out, "f %d\n", ids[i]);
+	else if (ops[i] != 0)
+	    fprintf(out, "%c %d %u\n", ops[i], ids[i], recs[i].size ? recs[i].size : 1);
+    }
+    fclose(out);
+    fprintf(stderr, "mm_record: wrote %d ops on %d ids to %s\n",
+	    num_ops, num_ids, out_path);
+}
+
+static void stop_in_child(void)
+{
+    recording = 0;
+}
+
+/*
+ * start_recording - open the raw file when the library is loaded
+ */
+static void __attribute__((constructor)) start_recording(void)
+{
+    char *env = getenv("MM_RECORD_FILE");
+    char *pid;
+    int len;
+
+    snprintf(out_path, sizeof(out_path), "%s", env ? env : "mm_record.rep");
+    if ((pid = strstr(out_path, "%p")) != NULL) {
+	len = pid - out_path;
+	snprintf(raw_path, sizeof(raw_path), "%.*s%d%s", len, out_path,
+		 (int)getpid(), pid + 2);
+	snprintf(out_path, sizeof(out_path), "%s", raw_path);
+    }
+    snprintf(raw_path, sizeof(raw_path), "%s.raw.%d", out_path, (int)getpid());
+    if ((raw_fd = open(raw_path, O_RDWR | O_CREAT | O_TRUNC, 0600)) < 0)
+	return;
+    unlink(raw_path);   /* the file goes away with the process */
+    pthread_key_create(&buf_key, flush_at_thread_exit);
+    pthread_atfork(NULL, NULL, stop_in_child);
+    recording = 1;
+}
+
+/*
+ * stop_recording - flush every buffer and write the trace at exit
+ */
+static void __attribute__((destructor)) stop_recording(void)
+{
+    int i;
+
+    if (!recording)
+	return;
+    recording = 0;
+    in_hook = 1;
+    pthread_mutex_lock(&flush_lock);
+    for (i = 0; i < num_buffers; i++)
+	if (buffers[i]->count > 0)
+	    flush_locked(buffers[i]);
+    pthread_mutex_unlock(&flush_lock);
+    write_trace();
+    close(raw_fd);
+}
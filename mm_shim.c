@@ -0,0 +1,207 @@
+/*
+ * mm_shim.c - exports the standard malloc interface on top of mm.c, so the
+ *     mm package can back real programs:
+ *
+ *         make libmm.so
+ *         LD_PRELOAD=./libmm.so <program>
+ *
+ *     The heap comes from memlib_mmap.c instead of the simulated heap in
+ *     memlib.c. mm.c is not thread-safe, so every call takes one global
+ *     lock. Pointers that don't belong to the mm heap (e.g. memory handed
+ *     out by the dynamic loader before the shim was in place) are ignored
+ *     by free and realloc.
+ *
+ *     The library is built with -fno-builtin, otherwise gcc turns the
+ *     malloc + memset in calloc into a call to calloc.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "mm.h"
+#include "memlib.h"
+
+/* mm.c keeps block sizes in 32 bits and mem_sbrk takes an int */
+#define MAX_REQUEST ((size_t)1 << 30)
+
+static pthread_mutex_t mm_lock = PTHREAD_MUTEX_INITIALIZER;
+static int mm_ready = 0;  /* set once mem_init and mm_init have run */
+
+/*
+ * shim_lock - take the global lock, and initialize the heap on first use
+ */
+static void shim_lock(void)
+{
+    pthread_mutex_lock(&mm_lock);
+    if (!mm_ready) {
+	mem_init();
+	mm_init();
+	mm_ready = 1;
+    }
+}
+
+static void shim_unlock(void)
+{
+    pthread_mutex_unlock(&mm_lock);
+}
+
+/*
+ * owned - is ptr a payload in the mm heap?
+ */
+static int owned(void *ptr)
+{
+    return ((char *)ptr >= (char *)mem_heap_lo()) &&
+	((char *)ptr <= (char *)mem_heap_hi());
+}
+
+/*
+ * The lock must be held across fork, so the child never inherits a heap
+ * in the middle of an update.
+ */
+static void shim_prepare(void) { shim_lock(); }
+static void shim_parent(void) { shim_unlock(); }
+static void shim_child(void) { pthread_mutex_init(&mm_lock, NULL); }
+
+static void __attribute__((constructor)) shim_register(void)
+{
+    pthread_atfork(shim_prepare, shim_parent, shim_child);
+}
+
+/*
+ * The standard interface
+ */
+void *malloc(size_t size)
+{
+    void *p;
+
+    if (size > MAX_REQUEST) {
+	errno = ENOMEM;
+	return NULL;
+    }
+    shim_lock();
+    p = mm_malloc(size ? size : 1);  /* malloc(0) returns a unique pointer */
+    shim_unlock();
+    if (p == NULL)
+	errno = ENOMEM;
+    return p;
+}
+
+void free(void *ptr)
+{
+    if (ptr == NULL)
+	return;
+    shim_lock();
+    if (owned(ptr))
+	mm_free(ptr);
+    shim_unlock();
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    void *p;
+
+    if (ptr == NULL)
+	return malloc(size);
+    if (size == 0) {
+	free(ptr);
+	return NULL;
+    }
+    if (size > MAX_REQUEST) {
+	errno = ENOMEM;
+	return NULL;
+    }
+    shim_lock();
+    p = owned(ptr) ? mm_realloc(ptr, size) : NULL;
+    shim_unlock();
+    if (p == NULL)
+	errno = ENOMEM;
+    return p;
+}
+
+/* glibc's reallocarray doesn't go through realloc, so it must be replaced too */
+void *reallocarray(void *ptr, size_t nmemb, size_t size)
+{
+    if (size != 0 && nmemb > SIZE_MAX / size) {
+	errno = ENOMEM;
+	return NULL;
+    }
+    return realloc(ptr, nmemb * size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+    void *p;
+
+    if (size != 0 && nmemb > SIZE_MAX / size) {
+	errno = ENOMEM;
+	return NULL;
+    }
+    /* freed blocks are reused, so the memory must be cleared */
+    if ((p = malloc(nmemb * size)) != NULL)
+	memset(p, 0, nmemb * size);
+    return p;
+}
+
+void *memalign(size_t alignment, size_t size)
+{
+    void *p;
+
+    if (alignment == 0 || (alignment & (alignment - 1)) != 0) {
+	errno = EINVAL;
+	return NULL;
+    }
+    if (size > MAX_REQUEST || alignment > MAX_REQUEST) {
+	errno = ENOMEM;
+	return NULL;
+    }
+    shim_lock();
+    p = mm_memalign(alignment, size ? size : 1);
+    shim_unlock();
+    if (p == NULL)
+	errno = ENOMEM;
+    return p;
+}
+
+int posix_memalign(void **memptr, size_t alignment, size_t size)
+{
+    void *p;
+
+    if (alignment % sizeof(void *) != 0 ||
+	(alignment & (alignment - 1)) != 0)
+	return EINVAL;
+    if ((p = memalign(alignment, size)) == NULL)
+	return ENOMEM;
+    *memptr = p;
+    return 0;
+}
+
+void *aligned_alloc(size_t alignment, size_t size)
+{
+    return memalign(alignment, size);
+}
+
+void *valloc(size_t size)
+{
+    return memalign(mem_pagesize(), size);
+}
+
+void *pvalloc(size_t size)
+{
+    size_t page = mem_pagesize();
+    return memalign(page, (size + page - 1) & ~(page - 1));
+}
+
+size_t malloc_usable_size(void *ptr)
+{
+    size_t size;
+
+    if (ptr == NULL)
+	return 0;
+    shim_lock();
+    size = owned(ptr) ? mm_usable_size(ptr) : 0;
+    shim_unlock();
+    return size;
+}
@@ -0,0 +1,121 @@
+/*
+ * perfctr.c - hardware performance counters (see perfctr.h)
+ */
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+
+#include "perfctr.h"
+
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#define CACHE_MISS(cache) \
+    ((cache) | (PERF_COUNT_HW_CACHE_OP_READ << 8) | \
+     (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+
+static struct {
+    unsigned type;
+    unsigned long long config;
+} events[PERF_COUNTERS] = {
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {PERF_TYPE_HW_CACHE, CACHE_MISS(PERF_COUNT_HW_CACHE_L1D)},
+    {PERF_TYPE_HW_CACHE, CACHE_MISS(PERF_COUNT_HW_CACHE_LL)},
+    {PERF_TYPE_HW_CACHE, CACHE_MISS(PERF_COUNT_HW_CACHE_DTLB)},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+};
+#endif
+
+char *perf_names[PERF_COUNTERS] = {
+    "cycles", "instructions", "l1d_misses", "llc_misses", "dtlb_misses",
+    "branch_misses"
+};
+
+static int fd[PERF_COUNTERS] = {-1, -1, -1, -1, -1, -1};
+static pid_t owner = 0;  /* the process the counters count */
+
+/*
+ * perf_open - open each counter, disabled. A forked child must open
+ *     its own counters: the ones it inherits count its parent.
+ */
+int perf_open(void)
+{
+    int n = 0;
+#ifdef __linux__
+    struct perf_event_attr attr;
+    int i;
+
+    perf_close();
+    owner = getpid();
+    for (i = 0; i < PERF_COUNTERS; i++) {
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = events[i].type;
+	attr.config = events[i].config;
+	attr.disabled = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	/* The counters may have to share the hardware; see perf_count */
+	attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+	    PERF_FORMAT_TOTAL_TIME_RUNNING;
+	fd[i] = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+	if (fd[i] >= 0)
+	    n++;
+    }
+#endif
+    return n;
+}
+
+/*
+ * perf_count - count the events of f(argp). When there are more
+ *     counters than the PMU has, the kernel multiplexes them, and each
+ *     count is scaled up from the time its counter actually ran. A reset
+ *     only clears the value, not the times, so all three are read before
+ *     and after, and the differences are used.
+ */
+void perf_count(void (*f)(void *), void *argp, double *values)
+{
+    uint64_t v0[PERF_COUNTERS][3];  /* value, time enabled, time running ... */
+    uint64_t v[3];                  /* ... before and after */
+    int i, ok[PERF_COUNTERS];
+
+    if (owner != getpid())
+	perf_open();
+    for (i = 0; i < PERF_COUNTERS; i++)
+	ok[i] = fd[i] >= 0 && read(fd[i], v0[i], sizeof(v0[i])) == sizeof(v0[i]);
+#ifdef __linux__
+    for (i = 0; i < PERF_COUNTERS; i++)
+	if (ok[i])
+	    ioctl(fd[i], PERF_EVENT_IOC_ENABLE, 0);
+#endif
+    f(argp);
+#ifdef __linux__
+    for (i = 0; i < PERF_COUNTERS; i++)
+	if (ok[i])
+	    ioctl(fd[i], PERF_EVENT_IOC_DISABLE, 0);
+#endif
+
+    for (i = 0; i < PERF_COUNTERS; i++) {
+	values[i] = -1;
+	if (ok[i] && read(fd[i], v, sizeof(v)) == sizeof(v) && v[2] > v0[i][2])
+	    values[i] = (double)(v[0] - v0[i][0]) * (v[1] - v0[i][1]) /
+		(v[2] - v0[i][2]);
+    }
+}
+
+/*
+ * perf_close - close the counters
+ */
+void perf_close(void)
+{
+    int i;
+
+    for (i = 0; i < PERF_COUNTERS; i++) {
+	if (fd[i] >= 0)
+	    close(fd[i]);
+	fd[i] = -1;
+    }
+}
@@ -0,0 +1,30 @@
+#ifndef __PERFCTR_H_
+#define __PERFCTR_H_
+
+#include <stdint.h>
+
+/*
+ * Hardware performance counters of the calling process, through
+ * perf_event_open (Linux only). Each counter is opened on its own, so
+ * that the ones the CPU, the kernel or perf_event_paranoid don't allow
+ * are simply missing. Only user-level events are counted.
+ */
+#define PERF_CYCLES       0
+#define PERF_INSTRUCTIONS 1
+#define PERF_L1D_MISSES   2
+#define PERF_LLC_MISSES   3
+#define PERF_DTLB_MISSES  4
+#define PERF_BRANCH_MISSES 5
+#define PERF_COUNTERS     6
+
+extern char *perf_names[PERF_COUNTERS];
+
+/* Open the counters; returns how many could be opened */
+int perf_open(void);
+
+/* Count from zero around f(argp); values[i] is -1 if counter i is missing */
+void perf_count(void (*f)(void *), void *argp, double *values);
+
+void perf_close(void);
+
+#endif /* __PERFCTR_H_ */
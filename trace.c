@@ -0,0 +1,919 @@
+/*
+ * trace.c - reading and writing trace files
+ *
+ * A trace is either a text file (the four header lines, then one request
+ * per line), which is parsed by several threads, or a binary file (see
+ * trace.h), which is mapped into memory and used in place. Either kind
+ * can also be streamed through a pair of windows.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <pthread.h>
+
+#include "trace.h"
+
+#define MAXLINE 1024 /* max string size */
+
+/* The op records of a binary trace are traceop_t's */
+typedef char op_size_check[(sizeof(traceop_t) == 3 * sizeof(int32_t)) ? 1 : -1];
+/* ... and its thread ids are int's */
+typedef char tid_size_check[(sizeof(int) == sizeof(int32_t)) ? 1 : -1];
+
+extern int verbose; /* -v option in mdriver.c */
+
+static char msg[MAXLINE]; /* for whenever we need to compose an error message */
+
+static void unix_error(char *msg);
+static void app_error(char *msg);
+
+/*
+ * checksum_words - add n 32-bit words to a 64-bit FNV-1a hash (a hash
+ *     of no words at all is the FNV offset basis)
+ */
+static uint64_t checksum_words(uint64_t hash, uint32_t *word, size_t n)
+{
+    size_t i;
+
+    if (word == NULL)
+	return 0xcbf29ce484222325ULL;
+    for (i = 0; i < n; i++) {
+	hash ^= word[i];
+	hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+/*
+ * trace_checksum - hash of the op records, then of their thread ids
+ *     (if tids isn't NULL), a 32-bit word at a time
+ */
+uint64_t trace_checksum(traceop_t *ops, int *tids, int num_ops)
+{
+    uint64_t hash;
+
+    hash = checksum_words(checksum_words(0, NULL, 0), (uint32_t *)ops,
+			  (size_t)num_ops * (sizeof(traceop_t) / sizeof(uint32_t)));
+    if (tids != NULL)
+	hash = checksum_words(hash, (uint32_t *)tids, num_ops);
+    return hash;
+}
+
+/*
+ * alloc_blocks - allocate the arrays that hold the blocks of a trace
+ *     while it is replayed
+ */
+static void alloc_blocks(trace_t *trace)
+{
+    /* We'll keep an array of pointers to the allocated blocks here... */
+    if ((trace->blocks =
+	 (char **)malloc(trace->num_ids * sizeof(char *))) == NULL)
+	unix_error("malloc 3 failed in read_trace");
+
+    /* ... along with the corresponding byte sizes of each block */
+    if ((trace->block_sizes =
+	 (size_t *)malloc(trace->num_ids * sizeof(size_t))) == NULL)
+	unix_error("malloc 4 failed in read_trace");
+}
+
+/*
+ * check_binary - check the header and checksum of a mapped binary trace,
+ *     and point the trace at its op records (and thread ids)
+ */
+static void check_binary(trace_t *trace, char *path)
+{
+    trace_header_t *hdr = (trace_header_t *)trace->map;
+    traceop_t *op;
+    size_t rec_size;
+    int i, ok, threaded;
+
+    if (trace->map_len < sizeof(trace_header_t)) {
+	sprintf(msg, "%s is truncated", path);
+	app_error(msg);
+    }
+    threaded = (hdr->version == TRACE_VERSION_TIDS);
+    if ((hdr->version != TRACE_VERSION && !threaded) ||
+	hdr->op_size != sizeof(traceop_t)) {
+	sprintf(msg, "%s has an unknown version or byte order", path);
+	app_error(msg);
+    }
+    rec_size = sizeof(traceop_t) + (threaded ? sizeof(int) : 0);
+    if (hdr->num_ops < 0 || hdr->num_ids < 0 ||
+	trace->map_len != sizeof(trace_header_t) +
+	(size_t)hdr->num_ops * rec_size) {
+	sprintf(msg, "%s has the wrong length", path);
+	app_error(msg);
+    }
+
+    trace->sugg_heapsize = hdr->sugg_heapsize;
+    trace->num_ids = hdr->num_ids;
+    trace->num_ops = hdr->num_ops;
+    trace->weight = hdr->weight;
+    trace->ops = (traceop_t *)(hdr + 1);
+    trace->tids = threaded ? (int *)(trace->ops + trace->num_ops) : NULL;
+    madvise(trace->map, trace->map_len, MADV_SEQUENTIAL);
+
+    if (trace_checksum(trace->ops, trace->tids, trace->num_ops) != hdr->checksum) {
+	sprintf(msg, "%s is corrupt (bad checksum)", path);
+	app_error(msg);
+    }
+
+    /*
+     * The replays index the blocks with the ids of the ops, and their
+     * per-thread state with the thread ids, so check them as the text
+     * parser does
+     */
+    trace->num_threads = 1;
+    for (i = 0; i < trace->num_ops; i++) {
+	op = &trace->ops[i];
+	switch (op->type) {
+	case ALLOC:
+	case FREE:
+	case REALLOC:
+	    ok = (op->index >= 0 && op->index < trace->num_ids);
+	    break;
+	case SIGNAL:
+	case WAIT:
+	    ok = (op->index >= 0);
+	    break;
+	default:
+	    ok = 0;
+	}
+	if (!ok) {
+	    sprintf(msg, "%s has a bad op record (op %d)", path, i);
+	    app_error(msg);
+	}
+	if (!threaded)
+	    continue;
+	if (trace->tids[i] < 0) {
+	    sprintf(msg, "%s has a bad thread id (op %d)", path, i);
+	    app_error(msg);
+	}
+	if (trace->tids[i] >= trace->num_threads)
+	    trace->num_threads = trace->tids[i] + 1;
+    }
+}
+
+/*
+ * The text parser. The file is mapped, and its request lines are split
+ * at line boundaries into chunks, which separate threads parse straight
+ * into the ops array. A first, cheap pass counts the requests in each
+ * chunk, so every thread knows where its ops go.
+ */
+
+#define PARSE_CHUNK   (1 << 20) /* min bytes per parser thread */
+#define PARSE_THREADS 16        /* max parser threads */
+
+typedef struct {
+    char *p, *end;        /* the chunk of the file */
+    traceop_t *ops;       /* where its requests go */
+    int *tids;            /* ... and their threads (NULL if none has one) */
+    int num_ops;          /* number of requests in the chunk */
+    int threaded;         /* does any request give its thread? */
+    unsigned max_index;   /* largest alloc/realloc id in the chunk */
+    unsigned max_tid;     /* largest thread id in the chunk */
+    char *error;          /* where parsing failed (the end of the chunk
+			     if a number is missing), or NULL */
+} chunk_t;
+
+#define IS_SPACE(c) ((c) == ' ' || (c) == '\n' || (c) == '\t' || (c) == '\r')
+
+/*
+ * scan_number - read an unsigned decimal number after optional white
+ *     space, like fscanf("%u"); returns NULL if there is none
+ */
+static char *scan_number(char *p, char *end, unsigned *val)
+{
+    unsigned x = 0;
+    char *start;
+
+    while (p < end && IS_SPACE(*p))
+	p++;
+    for (start = p; p < end && *p >= '0' && *p <= '9'; p++)
+	x = 10 * x + (*p - '0');
+    *val = x;
+    return (p == start) ? NULL : p;
+}
+
+/*
+ * count_chunk - count the lines of a chunk that hold a request
+ */
+static void *count_chunk(void *arg)
+{
+    chunk_t *c = (chunk_t *)arg;
+    char *p = c->p, *eol;
+
+    c->num_ops = 0;
+    c->threaded = 0;
+    while (p < c->end) {
+	while (p < c->end && IS_SPACE(*p))
+	    p++;
+	if (p == c->end)
+	    break;
+	c->num_ops++;
+	c->threaded |= (*p == '@');
+	if ((eol = memchr(p, '\n', c->end - p)) == NULL)
+	    break;
+	p = eol + 1;
+    }
+    return NULL;
+}
+
+/*
+ * parse_chunk - parse the requests of a chunk into c->ops
+ */
+static void *parse_chunk(void *arg)
+{
+    chunk_t *c = (chunk_t *)arg;
+    traceop_t *op = c->ops;
+    char *p = c->p, *end = c->end;
+    unsigned index, size, tid;
+    int n;
+
+    c->max_index = 0;
+    c->max_tid = 0;
+    c->error = NULL;
+    for (n = 0; ; n++, op++) {
+	while (p < end && IS_SPACE(*p))
+	    p++;
+	if (p == end)
+	    break;
+	if (n == c->num_ops) {  /* more than one request on a line */
+	    c->error = p;
+	    break;
+	}
+	tid = 0;
+	if (*p == '@') {        /* the thread that makes the request */
+	    if ((p = scan_number(p + 1, end, &tid)) == NULL) {
+		c->error = end;
+		break;
+	    }
+	    while (p < end && (*p == ' ' || *p == '\t'))
+		p++;
+	    if (p == end) {
+		c->error = end;
+		break;
+	    }
+	    if (tid > c->max_tid)
+		c->max_tid = tid;
+	}
+	if (c->tids != NULL)
+	    c->tids[n] = tid;
+	switch (*p) {
+	case 'a':
+	    op->type = ALLOC;
+	    break;
+	case 'r':
+	    op->type = REALLOC;
+	    break;
+	case 'f':
+	    op->type = FREE;
+	    break;
+	case 's':
+	    op->type = SIGNAL;
+	    break;
+	case 'w':
+	    op->type = WAIT;
+	    break;
+	default:
+	    c->error = p;
+	    return NULL;
+	}
+	while (p < end && !IS_SPACE(*p))  /* the rest of the type word */
+	    p++;
+	size = 0;
+	if ((p = scan_number(p, end, &index)) == NULL ||
+	    ((op->type == ALLOC || op->type == REALLOC) &&
+	     (p = scan_number(p, end, &size)) == NULL)) {
+	    c->error = end;
+	    break;
+	}
+	op->index = index;
+	op->size = size;
+	if ((op->type == ALLOC || op->type == REALLOC) && index > c->max_index)
+	    c->max_index = index;
+    }
+    return NULL;
+}
+
+/*
+ * run_chunks - run f on each of the n chunks, on a thread per chunk
+ */
+static void run_chunks(void *(*f)(void *), chunk_t *chunks, int n)
+{
+    pthread_t tid[PARSE_THREADS];
+    int i;
+
+    for (i = 1; i < n; i++)
+	if (pthread_create(&tid[i], NULL, f, &chunks[i]) != 0)
+	    unix_error("pthread_create failed in read_trace");
+    f(&chunks[0]);
+    for (i = 1; i < n; i++)
+	pthread_join(tid[i], NULL);
+}
+
+/*
+ * parse_trace - parse a mapped text trace file
+ */
+static void parse_trace(trace_t *trace, char *path)
+{
+    char *p = (char *)trace->map, *end = p + trace->map_len;
+    chunk_t chunks[PARSE_THREADS];
+    unsigned header[4];
+    unsigned max_index = 0, max_tid = 0;
+    int i, n, num_ops, threaded = 0;
+    long cpus;
+
+    /* Read the trace file header */
+    for (i = 0; i < 4; i++) {
+	while (p < end && IS_SPACE(*p))
+	    p++;
+	if (p < end && *p == '-')
+	    p++;
+	if ((p = scan_number(p, end, &header[i])) == NULL) {
+	    sprintf(msg, "Bad header in tracefile %s", path);
+	    app_error(msg);
+	}
+    }
+    trace->sugg_heapsize = header[0];  /* not used */
+    trace->num_ids = header[1];
+    trace->num_ops = header[2];
+    trace->weight = header[3];         /* not used */
+
+    /* Split the request lines into chunks of at least PARSE_CHUNK bytes */
+    cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    n = (end - p) / PARSE_CHUNK + 1;
+    n = (n > cpus) ? cpus : n;
+    n = (n > PARSE_THREADS) ? PARSE_THREADS : n;
+    n = (n < 1) ? 1 : n;
+    for (i = 0; i < n; i++) {
+	chunks[i].p = (i == 0) ? p : chunks[i - 1].end;
+	chunks[i].end = (i == n - 1) ? end : p + (end - p) / n * (i + 1);
+	if (chunks[i].end < chunks[i].p)
+	    chunks[i].end = chunks[i].p;
+	while (chunks[i].end < end && chunks[i].end[-1] != '\n')
+	    chunks[i].end++;
+    }
+
+    /* Count the requests, then parse each chunk into its part of ops */
+    run_chunks(count_chunk, chunks, n);
+    for (i = 0, num_ops = 0; i < n; i++) {
+	num_ops += chunks[i].num_ops;
+	threaded |= chunks[i].threaded;
+    }
+    if ((trace->ops =
+	 (traceop_t *)malloc((num_ops + 1) * sizeof(traceop_t))) == NULL)
+	unix_error("malloc 2 failed in read_trace");
+    if (threaded &&
+	(trace->tids = (int *)malloc((num_ops + 1) * sizeof(int))) == NULL)
+	unix_error("malloc 5 failed in read_trace");
+    for (i = 0, num_ops = 0; i < n; i++) {
+	chunks[i].ops = trace->ops + num_ops;
+	chunks[i].tids = threaded ? trace->tids + num_ops : NULL;
+	num_ops += chunks[i].num_ops;
+    }
+    run_chunks(parse_chunk, chunks, n);
+
+    for (i = 0; i < n; i++) {
+	if (chunks[i].error == chunks[i].end) {
+	    printf("Request with a missing number in tracefile %s\n", path);
+	    exit(1);
+	}
+	if (chunks[i].error != NULL) {
+	    printf("Bogus type character (%c) in tracefile %s\n",
+		   *chunks[i].error, path);
+	    exit(1);
+	}
+	if (chunks[i].max_index > max_index)
+	    max_index = chunks[i].max_index;
+	if (chunks[i].max_tid > max_tid)
+	    max_tid = chunks[i].max_tid;
+    }
+    trace->num_threads = max_tid + 1;
+    assert(max_index == trace->num_ids - 1);
+    assert(trace->num_ops == num_ops);
+}
+
+/*
+ * read_trace - read a trace file (text or binary) and store it in memory
+ */
+trace_t *read_trace(char *tracedir, char *filename)
+{
+    trace_t *trace;
+    char path[MAXLINE];
+    struct stat st;
+    int fd;
+
+    if (verbose > 1)
+	printf("Reading tracefile: %s\n", filename);
+
+    /* Allocate the trace record */
+    if ((trace = (trace_t *) calloc(1, sizeof(trace_t))) == NULL)
+	unix_error("malloc 1 failed in read_trance");
+
+    /* Map the trace file */
+    strcpy(path, tracedir);
+    strcat(path, filename);
+    if ((fd = open(path, O_RDONLY)) < 0) {
+	sprintf(msg, "Could not open %s in read_trace", path);
+	unix_error(msg);
+    }
+    if (fstat(fd, &st) < 0)
+	unix_error("fstat failed in read_trace");
+    if (st.st_size == 0) {
+	sprintf(msg, "%s is empty", path);
+	app_error(msg);
+    }
+    trace->map_len = st.st_size;
+    trace->map = mmap(NULL, trace->map_len, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (trace->map == MAP_FAILED)
+	unix_error("mmap failed in read_trace");
+    close(fd);
+
+    /* Binary traces start with the magic number, and are used in place */
+    if (trace->map_len >= sizeof(TRACE_MAGIC) &&
+	memcmp(trace->map, TRACE_MAGIC, sizeof(TRACE_MAGIC)) == 0) {
+	check_binary(trace, path);
+    } else {
+	parse_trace(trace, path);
+	munmap(trace->map, trace->map_len);
+	trace->map = NULL;
+	trace->map_len = 0;
+    }
+
+    alloc_blocks(trace);
+    return trace;
+}
+
+/*
+ * Streamed traces. A reader thread parses the file into two windows of
+ * ops in turn: while the replay works on one window, the reader fills
+ * the other. The file is read with read() in blocks of STREAM_BUF bytes,
+ * so it can be of any size, or a pipe ("-" is standard input).
+ */
+
+#define STREAM_WINDOW (1 << 16)  /* ops per window */
+#define STREAM_BUF    (1 << 20)  /* bytes read from the file at a time */
+
+struct trace_stream {
+    int fd;
+    int binary;             /* binary (or text) trace */
+    int threaded;           /* binary trace with thread ids */
+    char path[MAXLINE];
+    char *buf;              /* file data read but not yet parsed ... */
+    size_t pos, len;        /* ... is buf[pos, len) */
+    int eof;                /* set when the file has no more data */
+    uint64_t line;          /* current line, for error messages */
+    uint64_t num_ops;       /* requests in the header */
+    uint64_t ops_read;      /* requests parsed so far */
+    uint64_t recs_read;     /* binary op records read so far */
+    uint64_t checksum;      /* of the binary op records parsed so far */
+    uint64_t expected;      /* ... and the one in the header */
+    streamop_t *win[2];     /* the two windows ... */
+    size_t win_ops[2];      /* ... the number of ops in each ... */
+    int full[2];            /* ... and whether it is ready for the replay */
+    int cur;                /* window held by the replay, or -1 */
+    int done;               /* set to stop the reader */
+    pthread_t reader;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+};
+
+static void stream_error(trace_stream_t *s, char *what)
+{
+    if (s->binary)
+	sprintf(msg, "%s in tracefile %.900s", what, s->path);
+    else
+	sprintf(msg, "%s in tracefile %.900s, line %llu", what, s->path,
+		(unsigned long long)s->line);
+    app_error(msg);
+}
+
+/*
+ * fill_buf - move the unparsed data to the front of the buffer and
+ *     read more behind it; returns the number of bytes available
+ */
+static size_t fill_buf(trace_stream_t *s)
+{
+    ssize_t n;
+
+    memmove(s->buf, s->buf + s->pos, s->len - s->pos);
+    s->len -= s->pos;
+    s->pos = 0;
+    while (!s->eof && s->len < STREAM_BUF) {
+	if ((n = read(s->fd, s->buf + s->len, STREAM_BUF - s->len)) < 0) {
+	    if (errno == EINTR)
+		continue;
+	    unix_error("read failed in read_trace_stream");
+	}
+	if (n == 0)
+	    s->eof = 1;
+	s->len += n;
+    }
+    return s->len;
+}
+
+/*
+ * scan_number64 - like scan_number, for 64-bit numbers
+ */
+static char *scan_number64(char *p, char *end, uint64_t *val)
+{
+    uint64_t x = 0;
+    char *start;
+
+    while (p < end && IS_SPACE(*p))
+	p++;
+    for (start = p; p < end && *p >= '0' && *p <= '9'; p++)
+	x = 10 * x + (*p - '0');
+    *val = x;
+    return (p == start) ? NULL : p;
+}
+
+/*
+ * next_text_op - parse the next request of a text trace into op;
+ *     returns 0 at the end of the file
+ */
+static int next_text_op(trace_stream_t *s, streamop_t *op)
+{
+    char *p, *eol;
+    uint64_t index, size = 0;
+
+    while (1) {
+	/* Make sure a whole line is in the buffer */
+	p = s->buf + s->pos;
+	if ((eol = memchr(p, '\n', s->len - s->pos)) == NULL) {
+	    if (!s->eof) {
+		fill_buf(s);
+		if (s->len == STREAM_BUF &&
+		    memchr(s->buf, '\n', s->len) == NULL)
+		    stream_error(s, "Line too long");
+		continue;
+	    }
+	    if (s->pos == s->len)
+		return 0;
+	    eol = s->buf + s->len;
+	}
+	s->pos = (eol - s->buf) + (eol < s->buf + s->len);
+	s->line++;
+
+	while (p < eol && IS_SPACE(*p))
+	    p++;
+	if (p < eol)
+	    break;     /* not a blank line */
+    }
+
+    if (*p == '@') {   /* a streamed trace is replayed on one thread */
+	if ((p = scan_number64(p + 1, eol, &index)) == NULL)
+	    stream_error(s, "Request with a missing number");
+	while (p < eol && IS_SPACE(*p))
+	    p++;
+    }
+    switch (p < eol ? *p : ' ') {
+    case 'a':
+	op->type = ALLOC;
+	break;
+    case 'r':
+	op->type = REALLOC;
+	break;
+    case 'f':
+	op->type = FREE;
+	break;
+    case 's':
+	op->type = SIGNAL;
+	break;
+    case 'w':
+	op->type = WAIT;
+	break;
+    default:
+	stream_error(s, "Bogus type character");
+    }
+    while (p < eol && !IS_SPACE(*p))
+	p++;
+    if ((p = scan_number64(p, eol, &index)) == NULL ||
+	((op->type == ALLOC || op->type == REALLOC) &&
+	 scan_number64(p, eol, &size) == NULL))
+	stream_error(s, "Request with a missing number");
+    if (size > UINT_MAX)
+	stream_error(s, "Request size too large");
+    op->index = index;
+    op->size = (unsigned int)size;
+    return 1;
+}
+
+/*
+ * skip_binary_tids - read the thread ids that follow the op records of
+ *     a threaded binary trace, only to check them against the checksum
+ *     (a streamed trace is replayed on one thread)
+ */
+static void skip_binary_tids(trace_stream_t *s)
+{
+    uint32_t tid;
+    uint64_t i;
+
+    for (i = 0; i < s->num_ops; i++) {
+	if (s->len - s->pos < sizeof(tid) && fill_buf(s) < sizeof(tid))
+	    stream_error(s, "Truncated thread ids");
+	memcpy(&tid, s->buf + s->pos, sizeof(tid));
+	s->pos += sizeof(tid);
+	s->checksum = checksum_words(s->checksum, &tid, 1);
+    }
+    s->threaded = 0;    /* only op records could follow now */
+}
+
+/*
+ * next_binary_op - read the next op record of a binary trace into op;
+ *     returns 0 at the end of the file (or of the op records, if thread
+ *     ids follow them)
+ */
+static int next_binary_op(trace_stream_t *s, streamop_t *op)
+{
+    traceop_t rec;
+
+    if (s->threaded && s->recs_read == s->num_ops) {
+	skip_binary_tids(s);
+	return 0;
+    }
+    if (s->len - s->pos < sizeof(traceop_t) && fill_buf(s) < sizeof(traceop_t)) {
+	if (s->len != 0)
+	    stream_error(s, "Truncated op record");
+	return 0;
+    }
+    memcpy(&rec, s->buf + s->pos, sizeof(rec));
+    s->pos += sizeof(rec);
+    s->recs_read++;
+    s->checksum = checksum_words(s->checksum, (uint32_t *)&rec,
+				 sizeof(rec) / sizeof(uint32_t));
+    op->type = rec.type;
+    op->index = (unsigned)rec.index;
+    op->size = rec.size;
+    if (rec.type != ALLOC && rec.type != FREE && rec.type != REALLOC &&
+	rec.type != SIGNAL && rec.type != WAIT)
+	stream_error(s, "Bogus op record");
+    return 1;
+}
+
+/*
+ * stream_reader - the reader thread: fill the windows in turn, until
+ *     the end of the file (marked by an empty window)
+ */
+static void *stream_reader(void *arg)
+{
+    trace_stream_t *s = (trace_stream_t *)arg;
+    streamop_t *ops;
+    size_t n;
+    int w = 0, done;
+
+    while (1) {
+	pthread_mutex_lock(&s->lock);
+	while (s->full[w] && !s->done)
+	    pthread_cond_wait(&s->cond, &s->lock);
+	done = s->done;
+	pthread_mutex_unlock(&s->lock);
+	if (done)
+	    return NULL;
+
+	ops = s->win[w];
+	if (s->binary)
+	    for (n = 0; n < STREAM_WINDOW && next_binary_op(s, &ops[n]); n++)
+		;
+	else
+	    for (n = 0; n < STREAM_WINDOW && next_text_op(s, &ops[n]); n++)
+		;
+	s->ops_read += n;
+	if (n == 0) {
+	    if (s->ops_read != s->num_ops)
+		stream_error(s, "Wrong number of requests");
+	    if (s->binary && s->checksum != s->expected)
+		stream_error(s, "Bad checksum");
+	}
+
+	pthread_mutex_lock(&s->lock);
+	s->win_ops[w] = n;
+	s->full[w] = 1;
+	pthread_cond_broadcast(&s->cond);
+	pthread_mutex_unlock(&s->lock);
+	if (n == 0)
+	    return NULL;
+	w ^= 1;
+    }
+}
+
+/*
+ * open_trace_stream - read the header of a trace file, and start
+ *     reading its requests in the background
+ */
+trace_stream_t *open_trace_stream(char *tracedir, char *filename,
+				  uint64_t *num_ids, uint64_t *num_ops)
+{
+    trace_stream_t *s;
+    trace_header_t hdr;
+    uint64_t header[4];
+    char *p, *end;
+    int i;
+
+    if (verbose > 1)
+	printf("Streaming tracefile: %s\n", filename);
+
+    if ((s = (trace_stream_t *)calloc(1, sizeof(trace_stream_t))) == NULL ||
+	(s->buf = (char *)malloc(STREAM_BUF)) == NULL ||
+	(s->win[0] = (streamop_t *)malloc(STREAM_WINDOW * sizeof(streamop_t))) == NULL ||
+	(s->win[1] = (streamop_t *)malloc(STREAM_WINDOW * sizeof(streamop_t))) == NULL)
+	unix_error("malloc failed in open_trace_stream");
+
+    strcpy(s->path, tracedir);
+    strcat(s->path, filename);
+    if (!strcmp(filename, "-"))
+	s->fd = STDIN_FILENO;
+    else if ((s->fd = open(s->path, O_RDONLY)) < 0) {
+	sprintf(msg, "Could not open %s in open_trace_stream", s->path);
+	unix_error(msg);
+    }
+    fill_buf(s);
+
+    if (s->len >= sizeof(hdr) && memcmp(s->buf, TRACE_MAGIC, sizeof(TRACE_MAGIC)) == 0) {
+	s->binary = 1;
+	memcpy(&hdr, s->buf, sizeof(hdr));
+	s->pos = sizeof(hdr);
+	s->threaded = (hdr.version == TRACE_VERSION_TIDS);
+	if ((hdr.version != TRACE_VERSION && !s->threaded) ||
+	    hdr.op_size != sizeof(traceop_t))
+	    stream_error(s, "Unknown version or byte order");
+	*num_ids = (uint32_t)hdr.num_ids;
+	s->num_ops = (uint32_t)hdr.num_ops;
+	s->checksum = checksum_words(0, NULL, 0);
+	s->expected = hdr.checksum;
+    } else {
+	/* The four header numbers (the file starts with a full buffer) */
+	p = s->buf;
+	end = s->buf + s->len;
+	for (i = 0; i < 4; i++) {
+	    while (p < end && IS_SPACE(*p))
+		s->line += (*p++ == '\n');
+	    if (p < end && *p == '-')
+		p++;
+	    if ((p = scan_number64(p, end, &header[i])) == NULL)
+		stream_error(s, "Bad header");
+	}
+	*num_ids = header[1];
+	s->num_ops = header[2];
+	s->pos = p - s->buf;
+    }
+    *num_ops = s->num_ops;
+
+    s->cur = -1;
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_cond_init(&s->cond, NULL);
+    if (pthread_create(&s->reader, NULL, stream_reader, s) != 0)
+	unix_error("pthread_create failed in open_trace_stream");
+    return s;
+}
+
+/*
+ * read_trace_stream - hand the window the caller was working on back
+ *     to the reader, and wait for the next one; returns the number of
+ *     requests in *ops, 0 at the end of the trace
+ */
+size_t read_trace_stream(trace_stream_t *s, streamop_t **ops)
+{
+    size_t n;
+    int w;
+
+    pthread_mutex_lock(&s->lock);
+    if (s->cur >= 0) {
+	s->full[s->cur] = 0;
+	pthread_cond_broadcast(&s->cond);
+    }
+    w = s->cur = (s->cur + 1) & 1;
+    while (!s->full[w])
+	pthread_cond_wait(&s->cond, &s->lock);
+    n = s->win_ops[w];
+    pthread_mutex_unlock(&s->lock);
+
+    *ops = s->win[w];
+    return n;
+}
+
+/*
+ * close_trace_stream - stop the reader and free the stream
+ */
+void close_trace_stream(trace_stream_t *s)
+{
+    pthread_mutex_lock(&s->lock);
+    s->done = 1;
+    pthread_cond_broadcast(&s->cond);
+    pthread_mutex_unlock(&s->lock);
+    pthread_join(s->reader, NULL);
+
+    if (s->fd != STDIN_FILENO)
+	close(s->fd);
+    pthread_mutex_destroy(&s->lock);
+    pthread_cond_destroy(&s->cond);
+    free(s->win[0]);
+    free(s->win[1]);
+    free(s->buf);
+    free(s);
+}
+
+/*
+ * free_trace - Free the trace record and the arrays it points
+ *              to, all of which were allocated (or mapped) in read_trace().
+ */
+void free_trace(trace_t *trace)
+{
+    if (trace->map_len > 0)   /* unmap or free the three arrays... */
+	munmap(trace->map, trace->map_len);
+    else {
+	free(trace->ops);
+	free(trace->tids);
+    }
+    free(trace->blocks);
+    free(trace->block_sizes);
+    free(trace);              /* and the trace record itself... */
+}
+
+/*
+ * write_trace_text - write a trace in the text format
+ */
+void write_trace_text(FILE *fp, trace_t *trace)
+{
+    traceop_t *op;
+    int i;
+
+    fprintf(fp, "%d\n%d\n%d\n%d\n", trace->sugg_heapsize, trace->num_ids,
+	    trace->num_ops, trace->weight);
+    for (i = 0; i < trace->num_ops; i++) {
+	op = &trace->ops[i];
+	if (trace->tids != NULL)
+	    fprintf(fp, "@%d ", trace->tids[i]);
+	switch (op->type) {
+	case ALLOC:
+	    fprintf(fp, "a %d %d\n", op->index, op->size);
+	    break;
+	case REALLOC:
+	    fprintf(fp, "r %d %d\n", op->index, op->size);
+	    break;
+	case FREE:
+	    fprintf(fp, "f %d\n", op->index);
+	    break;
+	case SIGNAL:
+	    fprintf(fp, "s %d\n", op->index);
+	    break;
+	case WAIT:
+	    fprintf(fp, "w %d\n", op->index);
+	    break;
+	}
+    }
+}
+
+/*
+ * write_trace_binary - write a trace in the binary format (in the
+ *     version with thread ids only if the trace has them, so that the
+ *     files of unthreaded traces don't change)
+ */
+void write_trace_binary(FILE *fp, trace_t *trace)
+{
+    trace_header_t hdr;
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, TRACE_MAGIC, sizeof(hdr.magic));
+    hdr.version = trace->tids ? TRACE_VERSION_TIDS : TRACE_VERSION;
+    hdr.op_size = sizeof(traceop_t);
+    hdr.sugg_heapsize = trace->sugg_heapsize;
+    hdr.num_ids = trace->num_ids;
+    hdr.num_ops = trace->num_ops;
+    hdr.weight = trace->weight;
+    hdr.checksum = trace_checksum(trace->ops, trace->tids, trace->num_ops);
+
+    if (fwrite(&hdr, sizeof(hdr), 1, fp) != 1 ||
+	fwrite(trace->ops, sizeof(traceop_t), trace->num_ops, fp) !=
+	(size_t)trace->num_ops ||
+	(trace->tids != NULL &&
+	 fwrite(trace->tids, sizeof(int), trace->num_ops, fp) !=
+	 (size_t)trace->num_ops))
+	unix_error("fwrite failed in write_trace_binary");
+}
+
+/*
+ * unix_error - Report a Unix-style error
+ */
+static void unix_error(char *msg)
+{
+    printf("%s: %s\n", msg, strerror(errno));
+    exit(1);
+}
+
+/*
+ * app_error - Report an arbitrary application error
+ */
+static void app_error(char *msg)
+{
+    printf("%s\n", msg);
+    exit(1);
+}
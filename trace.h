@@ -0,0 +1,92 @@
+#ifndef __TRACE_H_
+#define __TRACE_H_
+
+#include <stdio.h>
+#include <stdint.h>
+
+/*
+ * Characterizes a single trace operation (allocator request). The ops
+ * of a multithreaded trace also include barriers: SIGNAL sets event
+ * index, and WAIT waits until that event is set. A serial replay is
+ * already in trace order, so it ignores them.
+ */
+typedef struct {
+    enum {ALLOC, FREE, REALLOC, SIGNAL, WAIT} type; /* type of request */
+    int index;                        /* index for free() to use later */
+    int size;                         /* byte size of alloc/realloc request */
+} traceop_t;
+
+/* Holds the information for one trace file*/
+typedef struct {
+    int sugg_heapsize;   /* suggested heap size (unused) */
+    int num_ids;         /* number of alloc/realloc ids */
+    int num_ops;         /* number of distinct requests */
+    int weight;          /* weight for this trace (unused) */
+    traceop_t *ops;      /* array of requests */
+    char **blocks;       /* array of ptrs returned by malloc/realloc... */
+    size_t *block_sizes; /* ... and a corresponding array of payload sizes */
+    void *map;           /* mapped binary trace file that ops points into */
+    size_t map_len;      /* ... and its length (0 if ops was malloc'ed) */
+    int num_threads;     /* 1 + the largest thread id */
+    int *tids;           /* thread of each op, or NULL if all are on thread 0 */
+} trace_t;
+
+/*
+ * In a text trace, a request line may start with "@<thread>" to give
+ * the thread that makes it (thread 0 if there is none). The barrier
+ * lines "s <event>" and "w <event>" signal and wait for an event, so
+ * that a thread can free a block that another thread allocated:
+ *
+ *     @0 a 7 100
+ *     @0 s 0
+ *     @1 w 0
+ *     @1 f 7
+ */
+
+/*
+ * Binary trace files: this header followed by num_ops records laid out
+ * exactly like traceop_t, in the byte order of the machine that wrote
+ * them. A threaded trace (TRACE_VERSION_TIDS) follows the records with
+ * the num_ops int32_t thread ids of the ops. They are mapped into memory
+ * and replayed without parsing. read_trace tells the two formats apart
+ * by the magic number.
+ */
+#define TRACE_MAGIC        "MMTRACE"  /* 8 bytes, with the '\0' */
+#define TRACE_VERSION      1          /* op records only */
+#define TRACE_VERSION_TIDS 2          /* op records, then their thread ids */
+
+typedef struct {
+    char magic[8];          /* TRACE_MAGIC */
+    uint32_t version;       /* TRACE_VERSION or TRACE_VERSION_TIDS */
+    uint32_t op_size;       /* sizeof(traceop_t) */
+    int32_t sugg_heapsize;  /* the four header fields of a text trace */
+    int32_t num_ids;
+    int32_t num_ops;
+    int32_t weight;
+    uint64_t checksum;      /* trace_checksum() of the records and ids */
+} trace_header_t;
+
+/*
+ * Streamed traces: the requests are read in windows by a reader thread
+ * while the previous window is replayed, so a trace never has to fit in
+ * memory. Ids and counts are 64 bits.
+ */
+typedef struct {
+    int type;                /* ALLOC, FREE or REALLOC */
+    unsigned int size;       /* byte size of alloc/realloc request */
+    uint64_t index;          /* block id */
+} streamop_t;
+
+typedef struct trace_stream trace_stream_t;
+
+trace_t *read_trace(char *tracedir, char *filename);
+void free_trace(trace_t *trace);
+void write_trace_text(FILE *fp, trace_t *trace);
+void write_trace_binary(FILE *fp, trace_t *trace);
+uint64_t trace_checksum(traceop_t *ops, int *tids, int num_ops);
+trace_stream_t *open_trace_stream(char *tracedir, char *filename,
+				  uint64_t *num_ids, uint64_t *num_ops);
+size_t read_trace_stream(trace_stream_t *s, streamop_t **ops);
+void close_trace_stream(trace_stream_t *s);
+
+#endif /* __TRACE_H_ */